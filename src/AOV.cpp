@@ -0,0 +1,170 @@
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include "AOV.hpp"
+#include "Scene.hpp"
+#include "Film.hpp"
+
+bool parseAOVs(const std::string &list, uint32_t &mask)
+{
+    static const std::pair<const char*, uint32_t> names[] = {
+        {"albedo", AOV_ALBEDO}, {"normal", AOV_NORMAL}, {"depth", AOV_DEPTH}, {"material", AOV_MATERIAL_ID},
+        {"object", AOV_OBJECT_ID}, {"direct", AOV_DIRECT}, {"indirect", AOV_INDIRECT}, {"samples", AOV_SAMPLE_COUNT},
+        {"all", AOV_ALL}
+    };
+    mask = 0;
+    std::stringstream ss(list);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        auto it = std::find_if(std::begin(names), std::end(names), [&](const std::pair<const char*, uint32_t> &n) {
+            return name == n.first;
+        });
+        if (it == std::end(names)) return false;
+        mask |= it->second;
+    }
+    return mask != 0;
+}
+
+AOVFilm::AOVFilm(const Scene &scene, int width, int height, uint32_t mask)
+    : mask(mask), width(width), height(height), count(width * height, 0)
+{
+    int n = width * height;
+    if (mask & AOV_ALBEDO) albedo.resize(n);
+    if (mask & AOV_NORMAL) normal.resize(n);
+    if (mask & AOV_DIRECT) direct.resize(n);
+    if (mask & AOV_INDIRECT) indirect.resize(n);
+    if (mask & AOV_DEPTH) depth.resize(n, 0.f);
+    if (mask & AOV_MATERIAL_ID) materialId.resize(n, -1.f);
+    if (mask & AOV_OBJECT_ID) objectId.resize(n, -1.f);
+
+    if (mask & (AOV_MATERIAL_ID | AOV_OBJECT_ID)) {
+        const auto &objects = scene.get_objects();
+        for (int k = 0; k < (int)objects.size(); ++k) {
+            std::vector<Object*> primitives;
+            objects[k]->getPrimitives(primitives);
+            primitives.push_back(objects[k]);
+            for (auto primitive : primitives) {
+                objectIds[primitive] = k;
+                Material *m = primitive->getMaterial();
+                if (m && !materialIds.count(m)) materialIds.emplace(m, (int)materialIds.size());
+            }
+        }
+    }
+}
+
+void AOVFilm::add(int index, const AOVSample &sample)
+{
+    bool first = count[index]++ == 0;
+    if (!sample.hit) {
+        if (mask & AOV_DIRECT) direct[index] += sample.direct;
+        return;
+    }
+    if (mask & AOV_ALBEDO) albedo[index] += sample.albedo;
+    if (mask & AOV_NORMAL) normal[index] += sample.normal;
+    if (mask & AOV_DEPTH) depth[index] += sample.depth;
+    if (mask & AOV_DIRECT) direct[index] += sample.direct;
+    if (mask & AOV_INDIRECT) indirect[index] += sample.indirect;
+    if (first && (mask & AOV_MATERIAL_ID)) {
+        auto it = materialIds.find(sample.m);
+        if (it != materialIds.end()) materialId[index] = it->second;
+    }
+    if (first && (mask & AOV_OBJECT_ID)) {
+        auto it = objectIds.find(sample.obj);
+        if (it != objectIds.end()) objectId[index] = it->second;
+    }
+}
+
+// 写出OpenEXR的一个头属性：名称、类型、大小、值
+static void writeAttribute(FILE *fp, const char *name, const char *type, const void *value, int32_t size)
+{
+    fwrite(name, 1, std::strlen(name) + 1, fp);
+    fwrite(type, 1, std::strlen(type) + 1, fp);
+    fwrite(&size, sizeof(int32_t), 1, fp);
+    fwrite(value, 1, size, fp);
+}
+
+bool AOVFilm::writeEXR(const std::string &filename, const Film &film, int rowBegin, int rowEnd) const
+{
+    // 每个通道：名称和取值函数，取值为像素平均值
+    struct Channel { std::string name; std::function<float(int)> value; };
+    std::vector<Channel> channels;
+    auto mean = [&](int index) { return count[index] > 0 ? 1.f / count[index] : 0.f; };
+    auto addRGB = [&](const std::string &layer, const std::vector<Vector3f> &buffer, const char *x, const char *y, const char *z) {
+        const std::vector<Vector3f> *b = &buffer;
+        channels.push_back({layer + x, [b, &mean](int i) { return (*b)[i].x * mean(i); }});
+        channels.push_back({layer + y, [b, &mean](int i) { return (*b)[i].y * mean(i); }});
+        channels.push_back({layer + z, [b, &mean](int i) { return (*b)[i].z * mean(i); }});
+    };
+    channels.push_back({"R", [&](int i) { return film.getPixel(i).x; }});
+    channels.push_back({"G", [&](int i) { return film.getPixel(i).y; }});
+    channels.push_back({"B", [&](int i) { return film.getPixel(i).z; }});
+    if (mask & AOV_ALBEDO) addRGB("albedo.", albedo, "R", "G", "B");
+    if (mask & AOV_NORMAL) addRGB("normal.", normal, "X", "Y", "Z");
+    if (mask & AOV_DIRECT) addRGB("direct.", direct, "R", "G", "B");
+    if (mask & AOV_INDIRECT) addRGB("indirect.", indirect, "R", "G", "B");
+    if (mask & AOV_DEPTH) channels.push_back({"depth.Z", [&](int i) { return depth[i] * mean(i); }});
+    if (mask & AOV_MATERIAL_ID) channels.push_back({"material.id", [&](int i) { return materialId[i]; }});
+    if (mask & AOV_OBJECT_ID) channels.push_back({"object.id", [&](int i) { return objectId[i]; }});
+    if (mask & AOV_SAMPLE_COUNT) channels.push_back({"samples.count", [&](int i) { return (float)film.sampleCount[i]; }});
+    // OpenEXR要求通道按名称排序
+    std::sort(channels.begin(), channels.end(), [](const Channel &a, const Channel &b) { return a.name < b.name; });
+
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        std::cerr << "Cannot open " << filename << " for writing\n";
+        return false;
+    }
+    const uint32_t magic = 20000630, version = 2; // 单图层、扫描线存储
+    fwrite(&magic, sizeof(uint32_t), 1, fp);
+    fwrite(&version, sizeof(uint32_t), 1, fp);
+
+    // channels: 每个通道为名称、像素类型（2 = FLOAT）、pLinear、3字节保留、x/y采样间隔，以空字节结束
+    std::vector<char> chlist;
+    for (auto &c : channels) {
+        chlist.insert(chlist.end(), c.name.begin(), c.name.end());
+        chlist.push_back(0);
+        int32_t fields[4] = {2, 0, 1, 1};
+        const char *bytes = reinterpret_cast<const char*>(fields);
+        chlist.insert(chlist.end(), bytes, bytes + sizeof(fields));
+    }
+    chlist.push_back(0);
+    writeAttribute(fp, "channels", "chlist", chlist.data(), chlist.size());
+    uint8_t compression = 0; // NO_COMPRESSION
+    writeAttribute(fp, "compression", "compression", &compression, 1);
+    int32_t window[4] = {0, 0, width - 1, height - 1};
+    writeAttribute(fp, "dataWindow", "box2i", window, sizeof(window));
+    writeAttribute(fp, "displayWindow", "box2i", window, sizeof(window));
+    uint8_t lineOrder = 0; // INCREASING_Y
+    writeAttribute(fp, "lineOrder", "lineOrder", &lineOrder, 1);
+    float aspect = 1.f, center[2] = {0.f, 0.f}, screenWidth = 1.f;
+    writeAttribute(fp, "pixelAspectRatio", "float", &aspect, sizeof(float));
+    writeAttribute(fp, "screenWindowCenter", "v2f", center, sizeof(center));
+    writeAttribute(fp, "screenWindowWidth", "float", &screenWidth, sizeof(float));
+    fputc(0, fp); // 头结束
+
+    // 偏移表：每一行（未压缩时一块一行）在文件中的位置
+    int32_t lineSize = width * (int32_t)channels.size() * sizeof(float);
+    uint64_t offset = (uint64_t)ftell(fp) + sizeof(uint64_t) * height;
+    for (int y = 0; y < height; ++y) {
+        fwrite(&offset, sizeof(uint64_t), 1, fp);
+        offset += 2 * sizeof(int32_t) + lineSize;
+    }
+
+    // 每一行：行号、数据大小，然后依次是各通道的一行数据
+    std::vector<float> line(width);
+    for (int32_t y = 0; y < height; ++y) {
+        fwrite(&y, sizeof(int32_t), 1, fp);
+        fwrite(&lineSize, sizeof(int32_t), 1, fp);
+        bool inside = y >= rowBegin && y < rowEnd;
+        for (auto &c : channels) {
+            for (int x = 0; x < width; ++x) line[x] = inside ? c.value(y * width + x) : 0.f;
+            fwrite(line.data(), sizeof(float), width, fp);
+        }
+    }
+    bool ok = !ferror(fp);
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) std::cerr << "Failed to write " << filename << "\n";
+    return ok;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+#include "Vector.hpp"
+
+class Scene;
+class Film;
+class Object;
+class Material;
+
+// 任意输出变量（AOV）：与主图同一轮渲染中累加的辅助图层，按位组合
+enum AOVFlag : uint32_t
+{
+    AOV_ALBEDO = 1 << 0, // 第一个交点处材质的颜色（getColorAt）
+    AOV_NORMAL = 1 << 1, // 第一个交点处的法线
+    AOV_DEPTH = 1 << 2, // 第一个交点的距离
+    AOV_MATERIAL_ID = 1 << 3, // 第一个交点的材质编号（按物体加入场景的顺序首次出现的顺序），未击中为-1
+    AOV_OBJECT_ID = 1 << 4, // 第一个交点所在物体在scene.objects中的下标，未击中为-1
+    AOV_DIRECT = 1 << 5, // 直接看到的光源/背景以及第一个交点处的直接光照
+    AOV_INDIRECT = 1 << 6, // 其余（经过至少两次弹射）的光照，direct + indirect = 主图
+    AOV_SAMPLE_COUNT = 1 << 7, // 像素的采样数
+    AOV_ALL = (1 << 8) - 1
+};
+
+// 解析逗号分隔的AOV名称（albedo,normal,depth,material,object,direct,indirect,samples或all），失败时返回false
+bool parseAOVs(const std::string &list, uint32_t &mask);
+
+// castRayPT在相机光线的第一个交点处填写的一个采样的AOV
+struct AOVSample
+{
+    bool hit = false;
+    Vector3f albedo, normal;
+    float depth = 0.f;
+    Material *m = nullptr;
+    Object *obj = nullptr;
+    Vector3f direct, indirect;
+};
+
+// 只为开启的AOV分配缓冲；编号类的AOV不能平均，取像素第一个采样的值
+// 所有图层连同主图（R, G, B）一起写到一个未压缩的多图层OpenEXR文件中（32位浮点，按通道名排序）
+class AOVFilm
+{
+public:
+    AOVFilm(const Scene &scene, int width, int height, uint32_t mask);
+
+    const uint32_t mask;
+
+    // 累加像素的一个采样，同一像素只能由一个线程写入
+    void add(int index, const AOVSample &sample);
+
+    // 写出行[rowBegin, rowEnd)，其余行为0
+    bool writeEXR(const std::string &filename, const Film &film, int rowBegin, int rowEnd) const;
+
+private:
+    int width, height;
+    std::vector<uint32_t> count; // 累加AOV的采样数（断点恢复前的采样没有AOV）
+    std::vector<Vector3f> albedo, normal, direct, indirect;
+    std::vector<float> depth, materialId, objectId;
+    std::unordered_map<const Material*, int> materialIds;
+    std::unordered_map<const Object*, int> objectIds; // 物体及其图元（如网格体的三角形）对应的编号
+};
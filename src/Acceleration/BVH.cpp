@@ -46,6 +46,10 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
         return node;
     }
     else if (objects.size() == 2) {
+        // 左子结点放在划分轴坐标较小的一侧，光线包遍历时据此决定先访问哪个子结点
+        const Vector3f c0 = objects[0]->getBounds().Centroid(), c1 = objects[1]->getBounds().Centroid();
+        node->splitAxis = Union(Bounds3(c0), c1).maxExtent();
+        if (c1[node->splitAxis] < c0[node->splitAxis]) std::swap(objects[0], objects[1]);
         node->left = recursiveBuild(std::vector{objects[0]});
         node->right = recursiveBuild(std::vector{objects[1]});
 
@@ -59,6 +63,7 @@ BVHBuildNode* BVHAccel::recursiveBuild(std::vector<Object*> objects)
             centroidBounds =
                 Union(centroidBounds, objects[i]->getBounds().Centroid());
         int dim = centroidBounds.maxExtent();
+        node->splitAxis = dim;
         // switch (dim) {
         // case 0:
         //     std::sort(objects.begin(), objects.end(), [](auto& f1, auto& f2) {
@@ -139,7 +144,7 @@ void BVHAccel::getSample(BVHBuildNode* node, float p, Intersection &pos, float &
 
 // 对bvh包围的所有物体中随机选取一个物体，并在这个物体上随机采样一点
 void BVHAccel::Sample(Intersection &pos, float &pdf){
-    float p = std::sqrt(get_random_float()) * root->area;
+    float p = get_random_float() * root->area; // 按面积均匀选择，p必须在[0, area)上均匀分布
     getSample(root, p, pos, pdf);
     pdf /= root->area;
 }
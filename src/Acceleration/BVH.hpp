@@ -8,6 +8,7 @@
 #include "Bounds3.hpp"
 #include "Intersection.hpp"
 #include "Vector.hpp"
+#include "RayPacket.hpp"
 
 struct BVHBuildNode;
 // BVHAccel Forward Declarations
@@ -28,6 +29,10 @@ public:
     Intersection Intersect(const Ray &ray) const;
     Intersection getIntersection(BVHBuildNode* node, const Ray& ray)const;
     bool IntersectP(const Ray &ray) const;
+    // 光线包求交：mask中的光线共享结点的读取，结果写入hits[k]，packet.tMax[k]更新为最近交点距离
+    // 只有距离小于packet.tMax[k]的交点才会写入hits[k]
+    template<int N>
+    void IntersectPacket(RayPacket<N> &packet, Intersection *hits, uint32_t mask) const;
     BVHBuildNode* root;
 
     // BVHAccel Private Methods
@@ -59,3 +64,57 @@ public:
     }
 };
 
+// 结点中仍相交的光线不超过这个比例时，认为光线包已经发散，改为逐条光线遍历子树
+#define PACKET_FALLBACK_RATIO 4
+
+template<int N>
+void BVHAccel::IntersectPacket(RayPacket<N> &packet, Intersection *hits, uint32_t mask) const
+{
+    if (!root || !mask) return;
+
+    // 逐条光线求交，只保留比已有交点更近的结果
+    auto intersectEach = [&](auto &&intersectOne, uint32_t lanes){
+        for (uint32_t bits = lanes; bits; bits &= bits - 1) {
+            int k = __builtin_ctz(bits);
+            Intersection inter = intersectOne(packet.getRay(k));
+            if (inter.happened && inter.distance < packet.tMax[k]) {
+                hits[k] = inter;
+                packet.tMax[k] = inter.distance;
+            }
+        }
+    };
+
+    struct StackEntry { BVHBuildNode* node; uint32_t mask; };
+    StackEntry stack[64];
+    int top = 0;
+    stack[top++] = {root, mask};
+    while (top > 0) {
+        StackEntry entry = stack[--top];
+        BVHBuildNode* node = entry.node;
+        uint32_t active = entry.mask & packet.intersectBounds(node->bounds);
+        if (!active) continue;
+
+        if (node->left == nullptr && node->right == nullptr) {
+            Object* object = node->object;
+            // 网格体直接用光线包遍历它自己的BVH
+            if (BVHAccel* sub = object->getBVH()) sub->IntersectPacket(packet, hits, active);
+            else intersectEach([&](const Ray &ray){ return object->getIntersection(ray); }, active);
+            continue;
+        }
+
+        // 光线包发散，逐条光线遍历子树
+        if (__builtin_popcount(active) * PACKET_FALLBACK_RATIO <= N || top + 2 > 64) {
+            intersectEach([&](const Ray &ray){ return getIntersection(node, ray); }, active);
+            continue;
+        }
+
+        // 按第一条光线在划分轴上的方向，先访问较近的子结点（后入栈）
+        int first = __builtin_ctz(active);
+        float dir = node->splitAxis == 0 ? packet.dx[first] : (node->splitAxis == 1 ? packet.dy[first] : packet.dz[first]);
+        BVHBuildNode* nearNode = dir < 0 ? node->right : node->left;
+        BVHBuildNode* farNode = dir < 0 ? node->left : node->right;
+        stack[top++] = {farNode, active};
+        stack[top++] = {nearNode, active};
+    }
+}
+
@@ -0,0 +1,43 @@
+#pragma once
+#include "Vector.hpp"
+#include "global.hpp"
+
+// 方向锥：以w为轴、半角的余弦为cosTheta的一组方向，用于光源BVH中界定光源的朝向
+// cosTheta为kInfinity表示空锥，-1表示整个球面
+struct DirectionCone
+{
+    Vector3f w = Vector3f(0.f, 0.f, 1.f);
+    float cosTheta = kInfinity;
+
+    DirectionCone() = default;
+    DirectionCone(const Vector3f &w, float cosTheta) : w(normalize(w)), cosTheta(cosTheta) {}
+
+    static DirectionCone EntireSphere() { return DirectionCone(Vector3f(0.f, 0.f, 1.f), -1.f); }
+    bool isEmpty() const { return cosTheta == kInfinity; }
+};
+
+// 包含a和b两个锥的最小方向锥，refer: pbrt-v4
+inline DirectionCone Union(const DirectionCone &a, const DirectionCone &b)
+{
+    if (a.isEmpty()) return b;
+    if (b.isEmpty()) return a;
+
+    auto safeAcos = [](float x){ return std::acos(clamp(-1.f, 1.f, x)); };
+    float theta_a = safeAcos(a.cosTheta), theta_b = safeAcos(b.cosTheta);
+    float theta_d = safeAcos(dotProduct(a.w, b.w));
+    // 其中一个锥已经包含另一个
+    if (std::min(theta_d + theta_b, M_PI) <= theta_a) return a;
+    if (std::min(theta_d + theta_a, M_PI) <= theta_b) return b;
+
+    float theta_o = (theta_a + theta_d + theta_b) / 2;
+    if (theta_o >= M_PI) return DirectionCone::EntireSphere();
+
+    // 把a.w绕a.w x b.w旋转theta_o - theta_a得到新的轴（Rodrigues公式）
+    float theta_r = theta_o - theta_a;
+    Vector3f axis = crossProduct(a.w, b.w);
+    if (dotProduct(axis, axis) == 0.f) return DirectionCone::EntireSphere();
+    axis = normalize(axis);
+    Vector3f w = a.w * std::cos(theta_r) + crossProduct(axis, a.w) * std::sin(theta_r) +
+                 axis * dotProduct(axis, a.w) * (1 - std::cos(theta_r));
+    return DirectionCone(w, std::cos(theta_o));
+}
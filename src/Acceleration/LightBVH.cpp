@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cassert>
+#include "LightBVH.hpp"
+
+LightBVH::LightBVH(const std::vector<Object*> &lightPrimitives)
+{
+    std::vector<Node> leaves;
+    for (auto object : lightPrimitives) {
+        float power = luminance(object->getMaterial()->getEmission()) * object->getArea();
+        if (power <= 0.f) continue;
+        Node leaf;
+        leaf.bounds = object->getBounds();
+        leaf.cone = object->getEmitCone();
+        leaf.power = power;
+        leaf.light = lights.size();
+        lights.push_back(object);
+        leaves.push_back(leaf);
+    }
+    if (leaves.empty()) return;
+    nodes.reserve(2 * leaves.size() - 1);
+    build(leaves, 0, leaves.size(), 0, 0);
+}
+
+// 按质心包围盒最长的轴在中位数处划分（与BVHAccel的NAIVE划分相同），返回结点下标
+int LightBVH::build(std::vector<Node> &leaves, int begin, int end, uint64_t trail, int depth)
+{
+    if (end - begin == 1) {
+        nodes.push_back(leaves[begin]);
+        trails[lights[leaves[begin].light]] = trail;
+        return nodes.size() - 1;
+    }
+    assert(depth < 64);
+
+    Node node;
+    Bounds3 centroidBounds;
+    for (int i = begin; i < end; ++i) {
+        node.bounds = Union(node.bounds, leaves[i].bounds);
+        node.cone = Union(node.cone, leaves[i].cone);
+        node.power += leaves[i].power;
+        centroidBounds = Union(centroidBounds, leaves[i].bounds.Centroid());
+    }
+
+    int dim = centroidBounds.maxExtent();
+    int mid = (begin + end) / 2;
+    std::nth_element(leaves.begin() + begin, leaves.begin() + mid, leaves.begin() + end,
+                     [dim](Node &a, Node &b){
+                         Vector3f ca = a.bounds.Centroid(), cb = b.bounds.Centroid();
+                         return dim == 0 ? ca.x < cb.x : (dim == 1 ? ca.y < cb.y : ca.z < cb.z);
+                     });
+
+    int index = nodes.size();
+    nodes.push_back(node);
+    build(leaves, begin, mid, trail, depth + 1);
+    int second = build(leaves, mid, end, trail | (uint64_t(1) << depth), depth + 1);
+    nodes[index].second = second;
+    return index;
+}
+
+// 结点内光源对着色点贡献的保守估计：功率 / 距离平方，乘上考虑包围盒张角后发光方向和入射方向夹角余弦的上界
+float LightBVH::importance(const Node &node, const Vector3f &p, const Vector3f &n) const
+{
+    Bounds3 bounds = node.bounds;
+    Vector3f pc = bounds.Centroid();
+    Vector3f d = p - pc;
+    float d2 = dotProduct(d, d);
+    Vector3f diag = bounds.Diagonal();
+    d2 = std::max(d2, std::sqrt(dotProduct(diag, diag)) / 2); // 着色点在包围盒附近时避免重要度过大
+
+    // cos(max(0, a - b))和sin(max(0, a - b))
+    auto cosSubClamped = [](float sinA, float cosA, float sinB, float cosB){
+        return cosA > cosB ? 1.f : cosA * cosB + sinA * sinB;
+    };
+    auto sinSubClamped = [](float sinA, float cosA, float sinB, float cosB){
+        return cosA > cosB ? 0.f : sinA * cosB - cosA * sinB;
+    };
+    auto sinFromCos = [](float c){ return std::sqrt(std::max(0.f, 1 - c * c)); };
+
+    Vector3f wi = normalize(d); // 从光源指向着色点
+    float cosTheta_w = dotProduct(node.cone.w, wi);
+    float sinTheta_w = sinFromCos(cosTheta_w);
+
+    // 从着色点看，包围盒张开的锥的半角theta_b
+    float cosTheta_b;
+    if (p.x >= bounds.pMin.x && p.x <= bounds.pMax.x && p.y >= bounds.pMin.y &&
+        p.y <= bounds.pMax.y && p.z >= bounds.pMin.z && p.z <= bounds.pMax.z) {
+        cosTheta_b = -1.f;
+    } else {
+        float r2 = dotProduct(diag, diag) / 4; // 包围球半径的平方
+        float dist2 = dotProduct(d, d);
+        cosTheta_b = dist2 > r2 ? std::sqrt(1 - r2 / dist2) : -1.f;
+    }
+    float sinTheta_b = sinFromCos(cosTheta_b);
+
+    // 发光方向与wi的最小夹角：theta' = max(0, theta_w - theta_o - theta_b)
+    float cosTheta_o = node.cone.cosTheta, sinTheta_o = sinFromCos(cosTheta_o);
+    float cosTheta_x = cosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    float sinTheta_x = sinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, cosTheta_o);
+    float cosThetap = cosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+    if (cosThetap <= 0.f) return 0.f; // 超出法线半球，不可能照亮着色点
+
+    float result = node.power * cosThetap / d2;
+
+    // 着色点法线与入射方向的最小夹角
+    if (n.x != 0.f || n.y != 0.f || n.z != 0.f) {
+        float cosTheta_i = std::fabs(dotProduct(wi, normalize(n)));
+        float sinTheta_i = sinFromCos(cosTheta_i);
+        result *= cosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+    }
+    return std::max(result, 0.f);
+}
+
+Object* LightBVH::Sample(const Vector3f &p, const Vector3f &n, float u, float &pmf) const
+{
+    pmf = 0.f;
+    if (nodes.empty()) return nullptr;
+    float prob = 1.f;
+    int index = 0;
+    while (nodes[index].light < 0) {
+        const Node &left = nodes[index + 1], &right = nodes[nodes[index].second];
+        float i0 = importance(left, p, n), i1 = importance(right, p, n);
+        if (i0 <= 0.f && i1 <= 0.f) return nullptr;
+        float p0 = i0 / (i0 + i1);
+        // 复用u：选中一侧后把u重新映射到[0, 1)
+        if (u < p0) {
+            index = index + 1;
+            u = std::min(u / p0, 1.f - std::numeric_limits<float>::epsilon());
+            prob *= p0;
+        } else {
+            index = nodes[index].second;
+            u = std::min((u - p0) / (1 - p0), 1.f - std::numeric_limits<float>::epsilon());
+            prob *= 1 - p0;
+        }
+    }
+    // 只有一个光源时也要检查它能否照亮着色点，与PMF保持一致
+    if (index == 0 && importance(nodes[0], p, n) <= 0.f) return nullptr;
+    pmf = prob;
+    return lights[nodes[index].light];
+}
+
+float LightBVH::PMF(const Vector3f &p, const Vector3f &n, const Object *light) const
+{
+    auto it = trails.find(light);
+    if (it == trails.end()) return 0.f;
+    uint64_t trail = it->second;
+    float prob = 1.f;
+    int index = 0;
+    while (nodes[index].light < 0) {
+        const Node &left = nodes[index + 1], &right = nodes[nodes[index].second];
+        float i0 = importance(left, p, n), i1 = importance(right, p, n);
+        if (i0 <= 0.f && i1 <= 0.f) return 0.f;
+        float p0 = i0 / (i0 + i1);
+        if (trail & 1) { index = nodes[index].second; prob *= 1 - p0; }
+        else { index = index + 1; prob *= p0; }
+        trail >>= 1;
+    }
+    if (index == 0 && importance(nodes[0], p, n) <= 0.f) return 0.f;
+    return prob;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "Object.hpp"
+#include "Bounds3.hpp"
+#include "DirectionCone.hpp"
+#include "Vector.hpp"
+
+// 光源BVH：对所有发光图元建树，每个结点保存包围盒、发光方向锥和总功率
+// 采样时从根结点开始，按两个子结点对着色点贡献的估计值（重要度）随机选择一侧，直到叶结点
+// 选中某个图元的概率是路径上各次选择概率的乘积，每个图元记录从根到叶的左右选择（比特串），可以精确地重算该概率用于MIS
+// 所有光源都是漫射面光源（在法线半球内发光），因此不单独记录发光范围的角度theta_e
+// refer: pbrt-v4, Importance Sampling of Many Lights with Adaptive Tree Splitting (Conty & Kulla 2018)
+class LightBVH
+{
+public:
+    explicit LightBVH(const std::vector<Object*> &lightPrimitives);
+
+    bool empty() const { return nodes.empty(); }
+
+    // 在着色点p（法线n，零向量表示不考虑法线，如介质中的散射点）处选择一个发光图元，pmf为选中它的概率
+    // u为[0, 1)的随机数；所有图元的重要度都为0时返回nullptr
+    Object* Sample(const Vector3f &p, const Vector3f &n, float u, float &pmf) const;
+
+    // 在着色点p处Sample选中图元light的概率
+    float PMF(const Vector3f &p, const Vector3f &n, const Object *light) const;
+
+private:
+    struct Node
+    {
+        Bounds3 bounds;
+        DirectionCone cone;
+        float power = 0.f; // 亮度 * 面积之和
+        int second = -1; // 右子结点下标，左子结点紧跟在当前结点之后
+        int light = -1; // 叶结点对应的图元，内部结点为-1
+    };
+    std::vector<Node> nodes;
+    std::vector<Object*> lights;
+    std::unordered_map<const Object*, uint64_t> trails; // 第d位为1表示在深度d处走向右子结点
+
+    int build(std::vector<Node> &leaves, int begin, int end, uint64_t trail, int depth);
+    float importance(const Node &node, const Vector3f &p, const Vector3f &n) const;
+};
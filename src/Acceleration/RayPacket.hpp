@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include "Ray.hpp"
+#include "Bounds3.hpp"
+#include "global.hpp"
+
+// 光线包：N条（4/8/16）光线以SoA形式存放，与包围盒求交时对所有光线做相同的运算，便于编译器向量化
+// active是位掩码，第k位为1表示第k条光线参与求交
+template<int N>
+struct RayPacket
+{
+    static_assert(N == 4 || N == 8 || N == 16, "packet size must be 4, 8 or 16");
+
+    alignas(64) float ox[N], oy[N], oz[N]; // 光线起点
+    alignas(64) float dx[N], dy[N], dz[N]; // 光线方向
+    alignas(64) float inv_dx[N], inv_dy[N], inv_dz[N]; // 方向的倒数
+    alignas(64) float tMax[N]; // 目前为止最近交点的距离，用于剪枝
+
+    void set(int k, const Ray &ray, float t_max = kInfinity)
+    {
+        ox[k] = ray.origin.x; oy[k] = ray.origin.y; oz[k] = ray.origin.z;
+        dx[k] = ray.direction.x; dy[k] = ray.direction.y; dz[k] = ray.direction.z;
+        inv_dx[k] = ray.direction_inv.x; inv_dy[k] = ray.direction_inv.y; inv_dz[k] = ray.direction_inv.z;
+        tMax[k] = t_max;
+    }
+
+    Ray getRay(int k) const { return Ray(Vector3f(ox[k], oy[k], oz[k]), Vector3f(dx[k], dy[k], dz[k])); }
+
+    // 所有光线同时与包围盒求交，返回相交光线的位掩码
+    // 判断条件与Bounds3::IntersectP相同，另外要求进入包围盒的距离不超过已有的最近交点
+    uint32_t intersectBounds(const Bounds3 &b) const
+    {
+        alignas(64) int hit[N];
+        for (int k = 0; k < N; ++k) {
+            float tx0 = (b.pMin.x - ox[k]) * inv_dx[k], tx1 = (b.pMax.x - ox[k]) * inv_dx[k];
+            float ty0 = (b.pMin.y - oy[k]) * inv_dy[k], ty1 = (b.pMax.y - oy[k]) * inv_dy[k];
+            float tz0 = (b.pMin.z - oz[k]) * inv_dz[k], tz1 = (b.pMax.z - oz[k]) * inv_dz[k];
+            float t_enter = std::max(std::min(tx0, tx1), std::max(std::min(ty0, ty1), std::min(tz0, tz1)));
+            float t_exit = std::min(std::max(tx0, tx1), std::min(std::max(ty0, ty1), std::max(tz0, tz1)));
+            hit[k] = (t_enter < t_exit + EPSILON) & (t_exit >= 0) & (t_enter <= tMax[k]);
+        }
+        uint32_t mask = 0;
+        for (int k = 0; k < N; ++k) mask |= (uint32_t)hit[k] << k;
+        return mask;
+    }
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// Walker/Vose别名表：按给定权重（不必归一化）离散采样，构建O(n)，每次采样O(1)
+// 把每个下标的概率乘n后切成n个等宽的桶，每个桶最多装两个下标：自己和一个“别名”
+// 采样时先均匀选桶，再用桶内阈值决定取自己还是别名
+class AliasTable
+{
+public:
+    AliasTable() = default;
+    explicit AliasTable(const std::vector<float> &weights) { build(weights); }
+
+    void build(const std::vector<float> &weights)
+    {
+        int n = weights.size();
+        bins.assign(n, Bin());
+        total = 0.0;
+        for (float w : weights) total += std::max(0.f, w);
+        if (n == 0 || total <= 0.0) { bins.clear(); return; }
+
+        std::vector<double> scaled(n);
+        std::vector<int> small, large;
+        for (int i = 0; i < n; ++i) {
+            bins[i].pmf = std::max(0.f, weights[i]) / total;
+            scaled[i] = bins[i].pmf * n;
+            (scaled[i] < 1.0 ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            int s = small.back(), l = large.back();
+            small.pop_back();
+            bins[s].threshold = scaled[s];
+            bins[s].alias = l;
+            scaled[l] -= 1.0 - scaled[s]; // l填满s的桶后剩余的部分
+            if (scaled[l] < 1.0) { large.pop_back(); small.push_back(l); }
+        }
+        // 剩下的桶由于舍入误差接近1，直接取自己
+        for (int i : small) { bins[i].threshold = 1.f; bins[i].alias = i; }
+        for (int i : large) { bins[i].threshold = 1.f; bins[i].alias = i; }
+    }
+
+    bool empty() const { return bins.empty(); }
+    int size() const { return bins.size(); }
+    double sum() const { return total; } // 权重之和
+    float pmf(int i) const { return bins[i].pmf; }
+
+    // u为[0, 1)的随机数，小数部分复用为桶内的随机数，返回选中的下标及其概率
+    int sample(float u, float &pmf) const
+    {
+        float scaled = u * bins.size();
+        int bin = std::min<int>(scaled, bins.size() - 1);
+        float v = scaled - bin;
+        int i = v < bins[bin].threshold ? bin : bins[bin].alias;
+        pmf = bins[i].pmf;
+        return i;
+    }
+
+private:
+    struct Bin
+    {
+        float threshold = 1.f; // 桶内随机数小于它时取自己，否则取别名
+        float pmf = 0.f; // 该下标的概率
+        int alias = 0;
+    };
+    std::vector<Bin> bins;
+    double total = 0.0;
+};
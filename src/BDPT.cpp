@@ -0,0 +1,361 @@
+#include "BDPT.hpp"
+#include "ShadingBatch.hpp"
+
+BDPTIntegrator::BDPTIntegrator(const Scene &scene, const Camera &camera) : scene(scene), camera(camera)
+{
+    std::vector<float> power;
+    for (auto emitter : scene.emitters)
+        power.push_back(luminance(emitter->getMaterial()->getEmission()) * emitter->getArea());
+    lightDistribution.build(power);
+    filmArea = (2 * camera.scale * camera.imageAspectRatio) * (2 * camera.scale);
+}
+
+// 相机朝向z轴正方向，与Camera::generateRay互逆
+bool BDPTIntegrator::cameraRaster(const Vector3f &p, float &x, float &y, float &We) const
+{
+    Vector3f d = p - camera.eye_pos;
+    if (d.z <= 0.f) return false;
+    x = (-d.x / d.z / (camera.imageAspectRatio * camera.scale) + 1) * camera.width / 2;
+    y = (1 - d.y / d.z / camera.scale) * camera.height / 2;
+    if (x < 0.f || x >= camera.width || y < 0.f || y >= camera.height) return false;
+    // 针孔相机的importance在z = 1平面上均匀：We = 1 / (A * cos^4)
+    float cosTheta = d.z / d.norm();
+    We = 1.f / (filmArea * cosTheta * cosTheta * cosTheta * cosTheta);
+    return true;
+}
+
+float BDPTIntegrator::cameraPdfDir(const Vector3f &w) const
+{
+    float x, y, We;
+    if (!cameraRaster(camera.eye_pos + w, x, y, We)) return 0.f;
+    float cosTheta = w.z / std::sqrt(dotProduct(w, w));
+    return 1.f / (filmArea * cosTheta * cosTheta * cosTheta);
+}
+
+float BDPTIntegrator::convertDensity(float pdf, const PathVertex &v, const PathVertex &next) const
+{
+    Vector3f w = next.p - v.p;
+    float dis2 = dotProduct(w, w);
+    if (dis2 == 0.f) return 0.f;
+    pdf /= dis2;
+    if (next.type != PathVertex::CAMERA) pdf *= std::fabs(dotProduct(next.n, w)) / std::sqrt(dis2);
+    return pdf;
+}
+
+// 光线从光源传到相机，相机子路径上wo为出射方向，光源子路径上wo为入射方向
+Vector3f BDPTIntegrator::f(const PathVertex &v, const PathVertex &next) const
+{
+    if (v.type != PathVertex::SURFACE || v.isEmitter()) return Vector3f(0.f);
+    Vector3f w = normalize(next.p - v.p);
+    return v.fromLight ? evalMaterial(scene.materials, v.m, v.wo, w, v.n, v.tcoords) : evalMaterial(scene.materials, v.m, w, v.wo, v.n, v.tcoords);
+}
+
+float BDPTIntegrator::pdf(const PathVertex &v, const PathVertex *prev, const PathVertex &next) const
+{
+    if (v.type == PathVertex::LIGHT) return pdfLight(v, next);
+    Vector3f wn = normalize(next.p - v.p);
+    float pdfDir;
+    if (v.type == PathVertex::CAMERA) pdfDir = cameraPdfDir(wn);
+    else {
+        if (v.isEmitter()) return 0.f;
+        Vector3f wp = prev ? normalize(prev->p - v.p) : v.wo;
+        pdfDir = pdfMaterial(scene.materials, v.m, wn, wp, v.n);
+    }
+    return convertDensity(pdfDir, v, next);
+}
+
+float BDPTIntegrator::pdfLightOrigin(const PathVertex &v) const
+{
+    auto it = scene.emitterIndex.find(v.obj);
+    if (it == scene.emitterIndex.end() || lightDistribution.empty()) return 0.f;
+    return lightDistribution.pmf(it->second) / scene.emitters[it->second]->getArea();
+}
+
+// 发光方向按余弦分布采样，立体角pdf为cos / pi
+float BDPTIntegrator::pdfLight(const PathVertex &v, const PathVertex &next) const
+{
+    Vector3f w = next.p - v.p;
+    float dis2 = dotProduct(w, w);
+    if (dis2 == 0.f) return 0.f;
+    w = w / std::sqrt(dis2);
+    float cosTheta = dotProduct(v.n, w);
+    if (cosTheta <= 0.f) return 0.f;
+    float pdf = cosTheta / M_PI / dis2;
+    if (next.type != PathVertex::CAMERA) pdf *= std::fabs(dotProduct(next.n, w));
+    return pdf;
+}
+
+Vector3f BDPTIntegrator::Le(const PathVertex &v, const Vector3f &w) const
+{
+    if (!v.m || dotProduct(v.n, w) <= 0.f) return Vector3f(0.f);
+    return v.m->getEmission();
+}
+
+bool BDPTIntegrator::visible(const PathVertex &a, const PathVertex &b) const
+{
+    Vector3f dir = b.p - a.p;
+    float dis = dir.norm();
+    dir = dir / dis;
+    Vector3f origin = a.p;
+    if (a.type != PathVertex::CAMERA)
+        origin = dotProduct(dir, a.n) > 0 ? a.p + a.n * EPSILON : a.p - a.n * EPSILON;
+    Intersection inter = scene.intersect(Ray(origin, dir));
+    return !inter.happened || inter.distance > dis - 0.01;
+}
+
+float BDPTIntegrator::G(const PathVertex &a, const PathVertex &b) const
+{
+    Vector3f w = b.p - a.p;
+    float dis2 = dotProduct(w, w);
+    if (dis2 == 0.f) return 0.f;
+    w = w / std::sqrt(dis2);
+    float g = 1.f / dis2;
+    if (a.type != PathVertex::CAMERA) g *= std::fabs(dotProduct(a.n, w));
+    if (b.type != PathVertex::CAMERA) g *= std::fabs(dotProduct(b.n, w));
+    if (g == 0.f || !visible(a, b)) return 0.f;
+    return g;
+}
+
+Vector3f BDPTIntegrator::randomWalk(Ray ray, Vector3f beta, float pdfDir, std::vector<PathVertex> &path,
+                                    bool fromLight, int maxVertices) const
+{
+    bool specular = true; // 当前光线由相机或镜面反射生成，击中环境光时不做MIS
+    for (int bounces = 0; bounces < maxVertices; ++bounces) {
+        Intersection inter = scene.intersect(ray);
+        if (!inter.happened) {
+            if (fromLight) return Vector3f(0.f);
+            float w = 1.f;
+            if (scene.environment && !specular) {
+                float envPdf = scene.environment->Pdf(ray.direction);
+                w = pdfDir * pdfDir / (pdfDir * pdfDir + envPdf * envPdf);
+            }
+            return beta * scene.background(ray.direction) * w;
+        }
+
+        PathVertex v;
+        v.beta = beta;
+        v.p = inter.coords;
+        v.n = inter.normal.normalized();
+        v.wo = -ray.direction;
+        v.m = inter.m;
+        v.tcoords = inter.tcoords;
+        v.obj = inter.obj;
+        v.fromLight = fromLight;
+        v.pdfFwd = convertDensity(pdfDir, path.back(), v);
+        path.push_back(v);
+        // 与castRayPT相同，击中光源后路径结束；透明材质只用于whitted-style
+        if (v.isEmitter() || v.m->getType() == TRANSPARENT || bounces + 1 == maxVertices) break;
+
+        Vector3f wi = normalize(sampleMaterial(scene.materials, v.m, v.wo, v.n));
+        float pdfFwd = pdfMaterial(scene.materials, v.m, wi, v.wo, v.n);
+        Vector3f fr = fromLight ? evalMaterial(scene.materials, v.m, v.wo, wi, v.n, v.tcoords) : evalMaterial(scene.materials, v.m, wi, v.wo, v.n, v.tcoords);
+        if (pdfFwd <= 0.f || (fr.x == 0.f && fr.y == 0.f && fr.z == 0.f)) break;
+        beta = beta * fr * std::fabs(dotProduct(wi, v.n)) / pdfFwd;
+        float pdfRev = pdfMaterial(scene.materials, v.m, v.wo, wi, v.n);
+        specular = v.m->getType() == MIRROR;
+        if (specular) {
+            path.back().delta = true;
+            pdfFwd = pdfRev = 0.f;
+        }
+        path[path.size() - 2].pdfRev = convertDensity(pdfRev, path.back(), path[path.size() - 2]);
+
+        if (bounces >= rrDepth) {
+            if (get_random_float() >= scene.RussianRoulette) break;
+            beta = beta / scene.RussianRoulette;
+        }
+        Vector3f origin = dotProduct(wi, v.n) > 0 ? v.p + v.n * EPSILON : v.p - v.n * EPSILON;
+        ray = Ray(origin, wi);
+        pdfDir = pdfFwd;
+    }
+    return Vector3f(0.f);
+}
+
+Vector3f BDPTIntegrator::generateCameraSubpath(float x, float y, std::vector<PathVertex> &path) const
+{
+    path.clear();
+    PathVertex v;
+    v.type = PathVertex::CAMERA;
+    v.p = camera.eye_pos;
+    v.beta = Vector3f(1.f);
+    path.push_back(v);
+    Ray ray = camera.generateRay(x, y);
+    // 针孔相机We * cos / pdf = 1
+    Vector3f L = randomWalk(ray, Vector3f(1.f), cameraPdfDir(ray.direction), path, false, maxDepth + 1);
+
+    // 环境光：在相机子路径每个可连接的顶点上按环境光的分布采样方向，与brdf采样击中环境光做MIS
+    if (scene.environment) {
+        for (int k = 1; k < (int)path.size() && k <= maxDepth; ++k) {
+            const PathVertex &pv = path[k];
+            if (!pv.isConnectible()) continue;
+            Vector3f wi;
+            float envPdf;
+            Vector3f Li = scene.environment->Sample(get_random_float(), get_random_float(), wi, envPdf);
+            float cosTheta = dotProduct(wi, pv.n);
+            if (envPdf <= 0.f || cosTheta <= 0.f) continue;
+            Vector3f fr = evalMaterial(scene.materials, pv.m, wi, pv.wo, pv.n, pv.tcoords);
+            if (fr.x == 0.f && fr.y == 0.f && fr.z == 0.f) continue;
+            if (scene.intersect(Ray(pv.p + pv.n * EPSILON, wi)).happened) continue;
+            float bsdfPdf = pdfMaterial(scene.materials, pv.m, wi, pv.wo, pv.n);
+            float w = envPdf * envPdf / (envPdf * envPdf + bsdfPdf * bsdfPdf);
+            L += pv.beta * fr * Li * cosTheta / envPdf * w;
+        }
+    }
+    return L;
+}
+
+void BDPTIntegrator::generateLightSubpath(std::vector<PathVertex> &path) const
+{
+    path.clear();
+    if (lightDistribution.empty()) return;
+    float pmf, pdfPos;
+    int k = lightDistribution.sample(get_random_float(), pmf);
+    Object *emitter = scene.emitters[k];
+    Intersection pos;
+    emitter->Sample(pos, pdfPos);
+    if (pmf <= 0.f || pdfPos <= 0.f) return;
+
+    PathVertex v;
+    v.type = PathVertex::LIGHT;
+    v.p = pos.coords;
+    v.n = pos.normal.normalized();
+    v.m = emitter->getMaterial();
+    v.obj = pos.obj ? pos.obj : emitter;
+    v.fromLight = true;
+    v.beta = v.m->getEmission();
+    v.pdfFwd = pmf * pdfPos;
+    path.push_back(v);
+
+    // 在法线一侧按余弦分布采样发光方向
+    float r = std::sqrt(get_random_float()), phi = 2 * M_PI * get_random_float();
+    float z = std::sqrt(std::max(0.f, 1 - r * r));
+    Vector3f b, c;
+    CoordinateSystem(v.n, b, c);
+    Vector3f w = normalize(r * std::cos(phi) * b + r * std::sin(phi) * c + z * v.n);
+    float pdfDir = z / M_PI;
+    if (pdfDir <= 0.f) return;
+    // beta = Le * cos / (pdfPos * pdfDir)
+    Vector3f beta = v.beta * M_PI / v.pdfFwd;
+    randomWalk(Ray(v.p + v.n * EPSILON, w), beta, pdfDir, path, true, maxDepth);
+}
+
+Vector3f BDPTIntegrator::connect(std::vector<PathVertex> &lightPath, std::vector<PathVertex> &cameraPath, int s, int t,
+                                 float &rasterX, float &rasterY) const
+{
+    Vector3f L(0.f);
+    PathVertex sampled;
+    if (s == 0) {
+        // 相机子路径直接击中光源
+        const PathVertex &pt = cameraPath[t - 1];
+        if (!pt.isEmitter()) return Vector3f(0.f);
+        L = pt.beta * Le(pt, pt.wo);
+    } else if (t == 1) {
+        // 光源子路径连接相机（light tracing）
+        const PathVertex &qs = lightPath[s - 1];
+        float We;
+        if (!qs.isConnectible() || !cameraRaster(qs.p, rasterX, rasterY, We)) return Vector3f(0.f);
+        sampled.type = PathVertex::CAMERA;
+        sampled.p = camera.eye_pos;
+        Vector3f d = sampled.p - qs.p;
+        float dis2 = dotProduct(d, d);
+        float cosCamera = -d.z / std::sqrt(dis2);
+        L = qs.beta * f(qs, sampled) * We * cosCamera / dis2 * std::fabs(dotProduct(normalize(d), qs.n));
+        if (L.x + L.y + L.z > 0.f && !visible(qs, sampled)) L = Vector3f(0.f);
+    } else if (s == 1) {
+        // 光源采样：重新在光源上采样一点与相机子路径连接，与光源子路径的起点同分布
+        const PathVertex &pt = cameraPath[t - 1];
+        if (!pt.isConnectible()) return Vector3f(0.f);
+        float pmf, pdfPos;
+        int k = lightDistribution.sample(get_random_float(), pmf);
+        Object *emitter = scene.emitters[k];
+        Intersection pos;
+        emitter->Sample(pos, pdfPos);
+        if (pmf <= 0.f || pdfPos <= 0.f) return Vector3f(0.f);
+        sampled.type = PathVertex::LIGHT;
+        sampled.p = pos.coords;
+        sampled.n = pos.normal.normalized();
+        sampled.m = emitter->getMaterial();
+        sampled.obj = pos.obj ? pos.obj : emitter;
+        sampled.fromLight = true;
+        sampled.pdfFwd = pmf * pdfPos;
+        sampled.beta = sampled.m->getEmission();
+        Vector3f Li = Le(sampled, normalize(pt.p - sampled.p));
+        L = pt.beta * f(pt, sampled) * Li / sampled.pdfFwd;
+        if (L.x + L.y + L.z > 0.f) L = L * G(pt, sampled);
+    } else {
+        const PathVertex &qs = lightPath[s - 1], &pt = cameraPath[t - 1];
+        if (!qs.isConnectible() || !pt.isConnectible()) return Vector3f(0.f);
+        L = qs.beta * f(qs, pt) * f(pt, qs) * pt.beta;
+        if (L.x + L.y + L.z > 0.f) L = L * G(qs, pt);
+    }
+    if (L.x + L.y + L.z <= 0.f) return Vector3f(0.f);
+    return L * misWeight(lightPath, cameraPath, sampled, s, t);
+}
+
+// balance heuristic：权重 = 1 / sum(p_i / p_(s,t))，比值沿子路径逐个顶点累乘得到，refer: pbrt-v3 MISWeight
+// delta顶点的pdf记为0，比值中按1处理，与它相邻的连接不可能发生，不计入
+float BDPTIntegrator::misWeight(std::vector<PathVertex> &lightPath, std::vector<PathVertex> &cameraPath,
+                                PathVertex &sampled, int s, int t) const
+{
+    if (s + t == 2) return 1.f;
+    // 当前策略重新采样的端点临时替换子路径上的顶点，计算后换回
+    if (s == 1) std::swap(lightPath[0], sampled);
+    else if (t == 1) std::swap(cameraPath[0], sampled);
+
+    PathVertex *qs = s > 0 ? &lightPath[s - 1] : nullptr, *pt = t > 0 ? &cameraPath[t - 1] : nullptr;
+    PathVertex *qsMinus = s > 1 ? &lightPath[s - 2] : nullptr, *ptMinus = t > 1 ? &cameraPath[t - 2] : nullptr;
+    PathVertex saved[4];
+    if (qs) saved[0] = *qs;
+    if (pt) saved[1] = *pt;
+    if (qsMinus) saved[2] = *qsMinus;
+    if (ptMinus) saved[3] = *ptMinus;
+
+    // 连接处的两个顶点按反方向重新计算pdfRev
+    if (pt) pt->delta = false;
+    if (qs) qs->delta = false;
+    if (pt) pt->pdfRev = s > 0 ? pdf(*qs, qsMinus, *pt) : pdfLightOrigin(*pt);
+    if (ptMinus) ptMinus->pdfRev = s > 0 ? pdf(*pt, qs, *ptMinus) : pdfLight(*pt, *ptMinus);
+    if (qs) qs->pdfRev = pdf(*pt, ptMinus, *qs);
+    if (qsMinus) qsMinus->pdfRev = pdf(*qs, pt, *qsMinus);
+
+    auto remap0 = [](float f) { return f != 0.f ? f : 1.f; };
+    float sumRi = 0.f, ri = 1.f;
+    for (int i = t - 1; i > 0; --i) {
+        ri *= remap0(cameraPath[i].pdfRev) / remap0(cameraPath[i].pdfFwd);
+        if (!cameraPath[i].delta && !cameraPath[i - 1].delta) sumRi += ri;
+    }
+    ri = 1.f;
+    for (int i = s - 1; i >= 0; --i) {
+        ri *= remap0(lightPath[i].pdfRev) / remap0(lightPath[i].pdfFwd);
+        bool deltaPrev = i > 0 && lightPath[i - 1].delta;
+        if (!lightPath[i].delta && !deltaPrev) sumRi += ri;
+    }
+
+    if (qs) *qs = saved[0];
+    if (pt) *pt = saved[1];
+    if (qsMinus) *qsMinus = saved[2];
+    if (ptMinus) *ptMinus = saved[3];
+    if (s == 1) std::swap(lightPath[0], sampled);
+    else if (t == 1) std::swap(cameraPath[0], sampled);
+    return 1.f / (1.f + sumRi);
+}
+
+Vector3f BDPTIntegrator::Li(int i, int j, Film &film) const
+{
+    // 每个线程复用子路径的存储
+    thread_local std::vector<PathVertex> cameraPath, lightPath;
+    Vector3f L = generateCameraSubpath(i + get_random_float(), j + get_random_float(), cameraPath);
+    generateLightSubpath(lightPath);
+
+    for (int t = 1; t <= (int)cameraPath.size(); ++t) {
+        for (int s = 0; s <= (int)lightPath.size(); ++s) {
+            int depth = s + t - 2;
+            if ((s == 1 && t == 1) || depth < 0 || depth > maxDepth) continue;
+            float rasterX, rasterY;
+            Vector3f Lpath = connect(lightPath, cameraPath, s, t, rasterX, rasterY);
+            if (Lpath.x + Lpath.y + Lpath.z <= 0.f) continue;
+            if (t == 1) film.addSplat(int(rasterY) * film.width + int(rasterX), Lpath);
+            else L += Lpath;
+        }
+    }
+    return L;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include "Scene.hpp"
+#include "Camera.hpp"
+#include "Film.hpp"
+#include "AliasTable.hpp"
+
+// 双向路径追踪的路径顶点
+struct PathVertex
+{
+    enum Type { CAMERA, LIGHT, SURFACE } type = SURFACE;
+    Vector3f beta; // 从子路径起点到该顶点（不含该顶点的brdf）的throughput
+    Vector3f p, n; // 位置、法线（相机顶点没有法线）
+    Vector3f wo; // 指向子路径上前一个顶点的方向
+    Material *m = nullptr;
+    Vector2f tcoords;
+    Object *obj = nullptr; // 所在物体，光源顶点和击中光源时用于计算光源采样的pdf
+    bool fromLight = false; // 是否属于光源子路径，决定brdf两个方向的顺序
+    bool delta = false; // 镜面反射等delta分布，不能与其他顶点连接
+    float pdfFwd = 0.f; // 沿子路径方向生成该顶点的pdf（面积度量）
+    float pdfRev = 0.f; // 从相反方向生成该顶点的pdf（面积度量），用于MIS
+
+    bool isEmitter() const { return m && m->hasEmission(); }
+    bool isConnectible() const { return type != SURFACE || (!delta && !isEmitter()); }
+};
+
+// 双向路径追踪（Bidirectional Path Tracing），refer: Veach 1997, pbrt-v3
+// 每个采样分别从相机和光源出发生成两条子路径，把相机子路径的前t个顶点与光源子路径的前s个顶点连接，
+// 得到长度相同、采样方式不同的多种策略（s, t），再用balance heuristic的MIS组合：
+// s = 0即相机路径直接击中光源，s = 1即光源采样（直接光照），t = 1即光源子路径连接相机（light tracing），
+// 后者落在任意像素上，以splat的形式线程安全地累加到film
+// 光源子路径从发光物体上按功率和面积采样起点，按余弦分布采样方向；光源只向法线一侧发光，击中光源后路径结束
+// 环境光只由相机子路径的两种策略估计（brdf采样击中和对环境光采样），二者单独做MIS
+class BDPTIntegrator
+{
+public:
+    BDPTIntegrator(const Scene &scene, const Camera &camera);
+
+    int maxDepth = 16; // 路径的最大弹射次数
+    int rrDepth = 3; // 子路径弹射超过rrDepth次后以scene.RussianRoulette的概率继续
+
+    // 像素(i, j)的一个采样：返回相机子路径上各策略的贡献（像素内随机抖动），light tracing的贡献直接splat到film
+    Vector3f Li(int i, int j, Film &film) const;
+
+private:
+    const Scene &scene;
+    const Camera &camera;
+    AliasTable lightDistribution; // 按功率（亮度 * 面积）选择光源子路径的起点，不含环境光
+    float filmArea; // 相机z = 1平面上胶片的面积
+
+    // 从path.back()沿ray（立体角pdf为pdfDir）随机游走，最多追加maxVertices个顶点
+    // 相机子路径未击中物体时返回背景/环境光的贡献（与环境光采样做MIS）
+    Vector3f randomWalk(Ray ray, Vector3f beta, float pdfDir, std::vector<PathVertex> &path, bool fromLight,
+                        int maxVertices) const;
+    // 从胶片上的点(x, y)生成相机子路径，返回环境光的贡献
+    Vector3f generateCameraSubpath(float x, float y, std::vector<PathVertex> &path) const;
+    void generateLightSubpath(std::vector<PathVertex> &path) const;
+
+    // 把立体角pdf转换为next处的面积pdf
+    float convertDensity(float pdf, const PathVertex &v, const PathVertex &next) const;
+    // 顶点v的brdf，入射、出射方向分别由子路径上前一个顶点和next决定
+    Vector3f f(const PathVertex &v, const PathVertex &next) const;
+    // 从v（前一个顶点prev）采样得到next的面积pdf
+    float pdf(const PathVertex &v, const PathVertex *prev, const PathVertex &next) const;
+    // 光源子路径选中发光顶点v的面积pdf，以及从v发光到达next的面积pdf
+    float pdfLightOrigin(const PathVertex &v) const;
+    float pdfLight(const PathVertex &v, const PathVertex &next) const;
+    // 发光顶点v向方向w（朝外）的radiance
+    Vector3f Le(const PathVertex &v, const Vector3f &w) const;
+    // 几何项（含可见性）
+    float G(const PathVertex &a, const PathVertex &b) const;
+    bool visible(const PathVertex &a, const PathVertex &b) const;
+
+    // 点p投影到胶片上的像素坐标，在视野外时返回false；We为对应方向的importance（z = 1平面上归一化）
+    bool cameraRaster(const Vector3f &p, float &x, float &y, float &We) const;
+    float cameraPdfDir(const Vector3f &w) const;
+
+    // 连接策略(s, t)，返回贡献并计算MIS权重；t = 1时raster为splat的像素坐标
+    Vector3f connect(std::vector<PathVertex> &lightPath, std::vector<PathVertex> &cameraPath, int s, int t,
+                     float &rasterX, float &rasterY) const;
+    float misWeight(std::vector<PathVertex> &lightPath, std::vector<PathVertex> &cameraPath,
+                    PathVertex &sampled, int s, int t) const;
+};
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Vector.hpp"
+#include "Ray.hpp"
+#include "global.hpp"
+
+// 针孔相机，始终朝向z轴正方向
+struct Camera
+{
+    Vector3f eye_pos;
+    int width, height;
+    float scale; // tan(fov / 2)
+    float imageAspectRatio;
+
+    Camera(const Vector3f &eye, int w, int h, float fov)
+        : eye_pos(eye), width(w), height(h),
+          scale(std::tan(fov * 0.5f * M_PI / 180.f)), imageAspectRatio(w / (float)h) {}
+
+    // 由屏幕坐标（像素坐标，像素中心为i + 0.5）生成主光线
+    Ray generateRay(float screen_i, float screen_j) const
+    {
+        // 从屏幕像素坐标转换到[-1，1]再转换为相机坐标系下的坐标
+        // 因为认为相机的始终朝向z轴，因此无论相机在哪个位置，dir都可以按照相机在原点计算，即在相机坐标系下计算
+        float x = (2 * screen_i / (float)width - 1) * imageAspectRatio * scale;
+        float y = (1 - 2 * screen_j / (float)height) * scale;
+        return Ray(eye_pos, normalize(Vector3f(-x, y, 1)));
+    }
+};
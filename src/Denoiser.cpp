@@ -0,0 +1,141 @@
+#include <atomic>
+#include <algorithm>
+#include "Denoiser.hpp"
+#include "global.hpp"
+#include <mingw.thread.h>
+
+static const int TILE_SIZE = 32;
+
+Denoiser::Denoiser(int width, int height, int thread_num)
+    : width(width), height(height), thread_num(thread_num),
+      albedo(width * height), normal(width * height), depth(width * height, 0.f), depthGradient(width * height, 0.f) {}
+
+template<typename Task>
+void Denoiser::parallelTiles(int rowBegin, int rowEnd, const Task &task) const
+{
+    int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE, tilesY = (rowEnd - rowBegin + TILE_SIZE - 1) / TILE_SIZE;
+    int tileNum = tilesX * tilesY;
+    std::atomic<int> nextTile(0);
+    auto worker = [&](){
+        for (int t = nextTile++; t < tileNum; t = nextTile++) {
+            int x0 = (t % tilesX) * TILE_SIZE, y0 = rowBegin + (t / tilesX) * TILE_SIZE;
+            seed_random((uint32_t)hash_combine(0x64656e6fu, t));
+            task(x0, y0, std::min(width, x0 + TILE_SIZE), std::min(rowEnd, y0 + TILE_SIZE));
+        }
+    };
+    int workerNum = std::min(thread_num, tileNum);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < workerNum; ++i) threads.emplace_back(worker);
+    worker(); // 当前线程也参与计算
+    for (auto &t : threads) t.join();
+}
+
+void Denoiser::collectFeatures(const Scene &scene, const Camera &camera, int rowBegin, int rowEnd)
+{
+    parallelTiles(rowBegin, rowEnd, [&](int x0, int y0, int x1, int y1) {
+        for (int j = y0; j < y1; ++j) for (int i = x0; i < x1; ++i) {
+            Vector3f a(0.f), n(0.f);
+            float z = 0.f;
+            for (int s = 0; s < featureSamples; ++s) {
+                Ray ray = camera.generateRay(i + get_random_float(), j + get_random_float());
+                float distance = 0.f;
+                // 镜面反射/折射最多跟随8次；透明材质取fresnel系数较大的方向
+                for (int bounce = 0; bounce < 8; ++bounce) {
+                    Intersection inter = scene.intersect(ray);
+                    if (!inter.happened) {
+                        a += Vector3f(1.f);
+                        break;
+                    }
+                    distance += inter.distance;
+                    Vector3f p = inter.coords, N = normalize(inter.normal), wo = -ray.direction;
+                    MaterialType type = inter.m->getType();
+                    if (!inter.m->hasEmission() && (type == MIRROR || type == TRANSPARENT)) {
+                        Vector3f reflectDir, refractDir;
+                        inter.m->getReflectRefract(wo, N, reflectDir, refractDir);
+                        Vector3f dir = type == MIRROR || inter.m->pdf(reflectDir, wo, N) >= 0.5f ? reflectDir : refractDir;
+                        ray = Ray(dotProduct(dir, N) > 0 ? p + N * EPSILON : p - N * EPSILON, dir);
+                        continue;
+                    }
+                    a += inter.m->hasEmission() ? Vector3f(1.f) : inter.m->getColorAt(inter.tcoords.x, inter.tcoords.y);
+                    n += N;
+                    z += distance;
+                    break;
+                }
+            }
+            int index = j * width + i;
+            albedo[index] = a / (float)featureSamples;
+            normal[index] = normalize(n);
+            depth[index] = z / featureSamples;
+        }
+    });
+    for (int j = rowBegin; j < rowEnd; ++j) for (int i = 0; i < width; ++i) {
+        int index = j * width + i;
+        float dx = i + 1 < width ? std::fabs(depth[index + 1] - depth[index]) : 0.f;
+        float dy = j + 1 < rowEnd ? std::fabs(depth[index + width] - depth[index]) : 0.f;
+        depthGradient[index] = std::max(dx, dy);
+    }
+}
+
+void Denoiser::denoise(std::vector<Vector3f> &color, const std::vector<float> &variance, int rowBegin, int rowEnd)
+{
+    // 去掉反照率（纹理），只对光照滤波
+    std::vector<Vector3f> illum(width * height), nextIllum(width * height);
+    std::vector<float> var(width * height, 0.f), nextVar(width * height, 0.f);
+    for (int index = rowBegin * width; index < rowEnd * width; ++index) {
+        Vector3f a = albedo[index];
+        Vector3f safe(std::max(a.x, 1e-3f), std::max(a.y, 1e-3f), std::max(a.z, 1e-3f));
+        illum[index] = Vector3f(color[index].x / safe.x, color[index].y / safe.y, color[index].z / safe.z);
+        float y = std::max(luminance(a), 1e-3f);
+        var[index] = variance[index] / (y * y);
+    }
+
+    static const float h[5] = {1.f / 16, 1.f / 4, 3.f / 8, 1.f / 4, 1.f / 16}; // B3样条
+    static const float g[3] = {1.f / 4, 1.f / 2, 1.f / 4};
+    for (int it = 0, step = 1; it < iterations; ++it, step *= 2) {
+        parallelTiles(rowBegin, rowEnd, [&](int x0, int y0, int x1, int y1) {
+            for (int j = y0; j < y1; ++j) for (int i = x0; i < x1; ++i) {
+                int p = j * width + i;
+                // 3x3高斯滤波后的方差，减少亮度权重受方差估计噪声的影响
+                float gVar = 0.f, gSum = 0.f;
+                for (int dy = -1; dy <= 1; ++dy) for (int dx = -1; dx <= 1; ++dx) {
+                    int qx = i + dx, qy = j + dy;
+                    if (qx < 0 || qx >= width || qy < rowBegin || qy >= rowEnd) continue;
+                    float w = g[dx + 1] * g[dy + 1];
+                    gVar += w * var[qy * width + qx];
+                    gSum += w;
+                }
+                float sigmaL = sigmaLuminance * std::sqrt(gVar / gSum) + 1e-6f;
+                float lp = luminance(illum[p]);
+
+                Vector3f sum(0.f);
+                float wSum = 0.f, vSum = 0.f;
+                for (int dy = -2; dy <= 2; ++dy) for (int dx = -2; dx <= 2; ++dx) {
+                    int qx = i + dx * step, qy = j + dy * step;
+                    if (qx < 0 || qx >= width || qy < rowBegin || qy >= rowEnd) continue;
+                    int q = qy * width + qx;
+                    float w = h[dx + 2] * h[dy + 2];
+                    if (q != p) {
+                        float wn = std::pow(std::max(0.f, dotProduct(normal[p], normal[q])), sigmaNormal);
+                        float dist = step * std::sqrt((float)(dx * dx + dy * dy));
+                        float wz = std::exp(-std::fabs(depth[p] - depth[q]) / (sigmaDepth * depthGradient[p] * dist + 1e-3f * depth[p] + 1e-6f));
+                        float wl = std::exp(-std::fabs(lp - luminance(illum[q])) / sigmaL);
+                        w *= wn * wz * wl;
+                    }
+                    sum += illum[q] * w;
+                    wSum += w;
+                    vSum += w * w * var[q];
+                }
+                nextIllum[p] = sum / wSum;
+                nextVar[p] = vSum / (wSum * wSum);
+            }
+        });
+        std::swap(illum, nextIllum);
+        std::swap(var, nextVar);
+    }
+
+    for (int index = rowBegin * width; index < rowEnd * width; ++index) {
+        Vector3f a = albedo[index];
+        Vector3f safe(std::max(a.x, 1e-3f), std::max(a.y, 1e-3f), std::max(a.z, 1e-3f));
+        color[index] = Vector3f(illum[index].x * safe.x, illum[index].y * safe.y, illum[index].z * safe.z);
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include "Scene.hpp"
+#include "Camera.hpp"
+
+// 渲染结束后的边缘保持降噪：edge-avoiding à-trous小波滤波，refer: Dammertz et al. 2010, Schied et al. 2017 (SVGF)
+// 特征（反照率、法线、深度）在相机路径经过镜面反射/折射后遇到的第一个非镜面着色点取得，像素内抖动取featureSamples个平均
+// 颜色先除以反照率得到光照，对光照做iterations次5x5的à-trous滤波（步长1, 2, 4, ...），权重由法线、深度
+// 以及亮度差相对于标准差（像素方差经3x3高斯滤波）的大小决定；每次滤波后方差按权重平方传播，最后乘回反照率
+// 特征收集和每次滤波都按tile分给多个线程
+class Denoiser
+{
+public:
+    Denoiser(int width, int height, int thread_num);
+
+    int iterations = 5;
+    int featureSamples = 4;
+    float sigmaLuminance = 4.f; // 亮度差相对于标准差的容忍度
+    float sigmaNormal = 128.f; // 法线夹角权重max(0, dot)^sigmaNormal
+    float sigmaDepth = 1.f; // 深度差相对于局部深度梯度的容忍度
+
+    // 收集行[rowBegin, rowEnd)的特征
+    void collectFeatures(const Scene &scene, const Camera &camera, int rowBegin, int rowEnd);
+    // 对行[rowBegin, rowEnd)降噪，color为像素颜色，variance为像素颜色均值的亮度方差，结果写回color
+    void denoise(std::vector<Vector3f> &color, const std::vector<float> &variance, int rowBegin, int rowEnd);
+
+private:
+    int width, height;
+    int thread_num;
+    std::vector<Vector3f> albedo, normal;
+    std::vector<float> depth;
+    std::vector<float> depthGradient; // 深度在屏幕空间的梯度（相邻像素深度差的最大值）
+
+    // 把行[rowBegin, rowEnd)切成tile，多线程依次领取
+    template<typename Task>
+    void parallelTiles(int rowBegin, int rowEnd, const Task &task) const;
+};
@@ -0,0 +1,89 @@
+#include <iostream>
+#include "EnvironmentLight.hpp"
+#include "stb_image.h"
+
+EnvironmentLight::EnvironmentLight(const std::string &path, float scale)
+{
+    int channel = 3;
+    float *data = stbi_loadf(path.c_str(), &width, &height, &channel, 3);
+    if (!data) {
+        std::cerr << "Failed to load environment map: " << path << "\n";
+        width = height = 0;
+        return;
+    }
+    image.resize(width * height);
+    for (int i = 0; i < width * height; ++i)
+        image[i] = scale * Vector3f(data[3 * i], data[3 * i + 1], data[3 * i + 2]);
+    stbi_image_free(data);
+
+    // 像素(x, y)对应的立体角正比于sin(theta)，乘上它之后分布的pdf才能转换为立体角度量
+    std::vector<float> func(width * height);
+    for (int y = 0; y < height; ++y) {
+        float sinTheta = std::sin(M_PI * (y + 0.5f) / height);
+        for (int x = 0; x < width; ++x)
+            func[y * width + x] = luminance(texel(x, y)) * sinTheta;
+    }
+    distribution = PiecewiseConstant2D(func.data(), width, height);
+}
+
+Vector2f EnvironmentLight::directionToUV(const Vector3f &w)
+{
+    float theta = std::acos(clamp(-1.f, 1.f, w.y));
+    float phi = std::atan2(w.z, w.x);
+    if (phi < 0.f) phi += 2 * M_PI;
+    return Vector2f(phi / (2 * M_PI), theta / M_PI);
+}
+
+Vector3f EnvironmentLight::uvToDirection(const Vector2f &uv)
+{
+    float theta = uv.y * M_PI, phi = uv.x * 2 * M_PI;
+    float sinTheta = std::sin(theta);
+    return Vector3f(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+}
+
+// 双线性插值，水平方向首尾相接
+Vector3f EnvironmentLight::Le(const Vector3f &w) const
+{
+    if (!valid()) return Vector3f(0.f);
+    Vector2f uv = directionToUV(normalize(w));
+    float x = uv.x * width - 0.5f, y = clamp(0.f, height - 1.f, uv.y * height - 0.5f);
+    int x0 = (int)std::floor(x), y0 = (int)y;
+    float dx = x - x0, dy = y - y0;
+    int x1 = (x0 + 1) % width, y1 = std::min(y0 + 1, height - 1);
+    x0 = (x0 + width) % width;
+    return (texel(x0, y0) * (1 - dx) + texel(x1, y0) * dx) * (1 - dy) +
+           (texel(x0, y1) * (1 - dx) + texel(x1, y1) * dx) * dy;
+}
+
+// 图像坐标上的pdf p(u, v)，经过(u, v) -> (theta, phi) -> 方向的两次换元，立体角pdf为p(u, v) / (2 * pi^2 * sin(theta))
+Vector3f EnvironmentLight::Sample(float u0, float u1, Vector3f &wi, float &pdf) const
+{
+    pdf = 0.f;
+    if (!valid()) return Vector3f(0.f);
+    float mapPdf;
+    Vector2f uv = distribution.sample(u0, u1, mapPdf);
+    if (mapPdf == 0.f) return Vector3f(0.f);
+    float sinTheta = std::sin(uv.y * M_PI);
+    if (sinTheta == 0.f) return Vector3f(0.f);
+    wi = uvToDirection(uv);
+    pdf = mapPdf / (2 * M_PI * M_PI * sinTheta);
+    return Le(wi);
+}
+
+float EnvironmentLight::Pdf(const Vector3f &w) const
+{
+    if (!valid()) return 0.f;
+    Vector2f uv = directionToUV(normalize(w));
+    float sinTheta = std::sin(uv.y * M_PI);
+    if (sinTheta == 0.f) return 0.f;
+    return distribution.pdf(uv) / (2 * M_PI * M_PI * sinTheta);
+}
+
+// 穿过场景包围球截面（pi * r^2）的功率为pi * r^2 * 亮度在球面上的积分，
+// 面光源的权重是亮度 * 面积（功率 / pi），这里同样除以pi
+// 亮度在球面上的积分 = 2 * pi^2 * 分布函数在[0, 1]^2上的积分
+float EnvironmentLight::power(float sceneRadius) const
+{
+    if (!valid()) return 0.f;
+    return sceneRadius * sceneRadius * 2 * M_PI * M_PI * distribution.integral();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Vector.hpp"
+#include "Sampling.hpp"
+
+// 环境光：从无穷远处照亮场景，radiance由等距柱状投影（经纬度）的HDR图给出
+// 图像的列对应方位角phi，行对应与+y轴（向上）的夹角theta，第0行为正上方
+// 以每个像素的亮度 * sin(theta)为权重建立二维分段常数分布，按图像亮度对方向重要性采样，
+// 太阳等小而亮的区域几乎总能被光源采样找到，不再只能靠brdf采样偶然击中
+class EnvironmentLight
+{
+public:
+    // 读取.hdr/.exr等stb_image支持的图像，scale为radiance的缩放系数；读取失败时valid()为false
+    explicit EnvironmentLight(const std::string &path, float scale = 1.f);
+
+    bool valid() const { return width > 0 && height > 0; }
+
+    // 从方向w（从场景指向天空）到达的radiance
+    Vector3f Le(const Vector3f &w) const;
+
+    // 按分布采样一个方向wi，pdf为立体角度量，返回该方向的radiance；pdf为0表示采样失败
+    Vector3f Sample(float u0, float u1, Vector3f &wi, float &pdf) const;
+    // Sample采样到方向w的立体角pdf
+    float Pdf(const Vector3f &w) const;
+
+    // 半径为sceneRadius的场景接收到的功率的估计，与面光源的亮度 * 面积可比，用于按功率选择光源
+    float power(float sceneRadius) const;
+
+    int width = 0, height = 0;
+
+private:
+    std::vector<Vector3f> image; // 按行存放，已乘scale
+    PiecewiseConstant2D distribution;
+
+    Vector3f texel(int x, int y) const { return image[y * width + x]; }
+    // 单位方向与图像坐标[0, 1)^2的互相转换
+    static Vector2f directionToUV(const Vector3f &w);
+    static Vector3f uvToDirection(const Vector2f &uv);
+};
@@ -0,0 +1,96 @@
+#include <cstdio>
+#include <cstring>
+#include "Film.hpp"
+#include "global.hpp"
+
+static const char FILM_MAGIC[4] = {'M', 'P', 'T', 'F'};
+static const uint32_t FILM_VERSION = 4;
+
+void Film::writePPM(const std::string &filename) const
+{
+    std::vector<Vector3f> pixels(width * height);
+    for (int i = 0; i < width * height; ++i) pixels[i] = getPixel(i);
+    writePPM(filename, width, height, pixels);
+}
+
+void Film::writePPM(const std::string &filename, int width, int height, const std::vector<Vector3f> &pixels)
+{
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        std::cerr << "Cannot open " << filename << " for writing\n";
+        return;
+    }
+    (void)fprintf(fp, "P6\n%d %d\n255\n", width, height);
+    for (auto i = 0; i < height * width; ++i) {
+        static unsigned char color[3];
+        // gamma correction
+        //framebuffer[i] = pow(framebuffer[i], 1 / GAMMA_C);
+        const Vector3f &pixel = pixels[i];
+        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, pixel.x), 0.6f));
+        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, pixel.y), 0.6f));
+        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, pixel.z), 0.6f));
+        fwrite(color, 1, 3, fp);
+    }
+    fclose(fp);
+}
+
+// 先写入临时文件再重命名，防止写到一半被杀掉导致断点文件损坏
+bool Film::save(const std::string &filename, const FilmHeader &header) const
+{
+    std::string tmp = filename + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if (!fp) {
+        std::cerr << "Cannot open " << tmp << " for writing\n";
+        return false;
+    }
+    bool ok = fwrite(FILM_MAGIC, 1, 4, fp) == 4;
+    ok = ok && fwrite(&FILM_VERSION, sizeof(uint32_t), 1, fp) == 1;
+    ok = ok && fwrite(&width, sizeof(int), 1, fp) == 1;
+    ok = ok && fwrite(&height, sizeof(int), 1, fp) == 1;
+    ok = ok && fwrite(&header, sizeof(FilmHeader), 1, fp) == 1;
+    ok = ok && fwrite(radiance.data(), sizeof(Vector3f), radiance.size(), fp) == radiance.size();
+    ok = ok && fwrite(sampleCount.data(), sizeof(uint32_t), sampleCount.size(), fp) == sampleCount.size();
+    std::vector<float> splatData(splat.begin(), splat.end());
+    uint64_t paths = lightPaths;
+    ok = ok && fwrite(&paths, sizeof(uint64_t), 1, fp) == 1;
+    ok = ok && fwrite(splatData.data(), sizeof(float), splatData.size(), fp) == splatData.size();
+    ok = ok && fwrite(luminanceSq.data(), sizeof(float), luminanceSq.size(), fp) == luminanceSq.size();
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) {
+        std::cerr << "Failed to write " << tmp << "\n";
+        return false;
+    }
+    std::remove(filename.c_str()); // windows下rename不能覆盖已存在的文件
+    return std::rename(tmp.c_str(), filename.c_str()) == 0;
+}
+
+bool Film::load(const std::string &filename, FilmHeader &header)
+{
+    FILE* fp = fopen(filename.c_str(), "rb");
+    if (!fp) {
+        std::cerr << "Cannot open " << filename << "\n";
+        return false;
+    }
+    char magic[4];
+    uint32_t version = 0;
+    int w = 0, h = 0;
+    bool ok = fread(magic, 1, 4, fp) == 4 && std::memcmp(magic, FILM_MAGIC, 4) == 0;
+    ok = ok && fread(&version, sizeof(uint32_t), 1, fp) == 1 && version == FILM_VERSION;
+    ok = ok && fread(&w, sizeof(int), 1, fp) == 1 && fread(&h, sizeof(int), 1, fp) == 1;
+    ok = ok && w == width && h == height;
+    ok = ok && fread(&header, sizeof(FilmHeader), 1, fp) == 1;
+    ok = ok && fread(radiance.data(), sizeof(Vector3f), radiance.size(), fp) == radiance.size();
+    ok = ok && fread(sampleCount.data(), sizeof(uint32_t), sampleCount.size(), fp) == sampleCount.size();
+    std::vector<float> splatData(splat.size());
+    uint64_t paths = 0;
+    ok = ok && fread(&paths, sizeof(uint64_t), 1, fp) == 1;
+    ok = ok && fread(splatData.data(), sizeof(float), splatData.size(), fp) == splatData.size();
+    ok = ok && fread(luminanceSq.data(), sizeof(float), luminanceSq.size(), fp) == luminanceSq.size();
+    fclose(fp);
+    if (ok) {
+        lightPaths = paths;
+        for (size_t i = 0; i < splat.size(); ++i) splat[i] = splatData[i];
+    }
+    if (!ok) std::cerr << filename << " is not a valid film file for a " << width << "x" << height << " image\n";
+    return ok;
+}
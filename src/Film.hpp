@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+#include "Vector.hpp"
+
+// 断点/部分结果文件头，记录恢复渲染和合并所需的状态
+struct FilmHeader
+{
+    uint64_t sceneHash = 0; // 场景/设置哈希，恢复和合并时必须一致
+    uint32_t seed = 0; // 随机数种子，每一轮每一行的种子由它派生
+    uint32_t spp = 0; // 目标采样数
+    uint32_t passSpp = 0; // 每一轮每个像素的采样数
+    // 分片：负责的行范围[rowBegin, rowEnd)和采样序号范围[sampleBegin, sampleEnd)
+    uint32_t rowBegin = 0, rowEnd = 0;
+    uint32_t sampleBegin = 0, sampleEnd = 0;
+};
+
+// 胶片：存储每个像素radiance的累加和（不除以spp）以及已完成的采样数
+// 最终颜色 = 累加和 / 采样数，因此可以在任意时刻保存、恢复
+// 双向路径追踪中光路直接连接相机的贡献可能落在任意像素上（splat），由多个线程同时累加到splat中，
+// 它按光路数归一化：每个像素平均分到lightPaths / 像素数条光路
+class Film
+{
+public:
+    int width, height;
+    std::vector<Vector3f> radiance; // 每个像素radiance的累加和
+    std::vector<uint32_t> sampleCount; // 每个像素已完成的采样数
+    std::vector<std::atomic<float> > splat; // 每个像素splat的累加和，按rgb依次存放
+    std::atomic<uint64_t> lightPaths; // 产生splat的光路总数
+    std::vector<float> luminanceSq; // 每个像素各采样亮度平方的累加和，用于估计方差（降噪）
+
+    Film(int w, int h) : width(w), height(h), radiance(w * h), sampleCount(w * h, 0), splat(3 * w * h), lightPaths(0),
+                         luminanceSq(w * h, 0.f) {}
+
+    // 累加像素的一个采样
+    void addSample(int index, const Vector3f &L) {
+        radiance[index] += L;
+        float y = luminance(L);
+        luminanceSq[index] += y * y;
+        sampleCount[index]++;
+    }
+
+    // 像素均值（不含splat）亮度的方差估计，采样数不足2时返回0
+    float variance(int index) const {
+        uint32_t n = sampleCount[index];
+        if (n < 2) return 0.f;
+        float mean = luminance(radiance[index]) / n;
+        return std::max(0.f, luminanceSq[index] / n - mean * mean) / (n - 1);
+    }
+
+    // 像素的平均radiance
+    Vector3f getPixel(int index) const {
+        Vector3f L = sampleCount[index] > 0 ? radiance[index] / (float)sampleCount[index] : Vector3f(0.f);
+        uint64_t paths = lightPaths;
+        if (paths > 0) L += getSplat(index) * (float)((double)width * height / paths);
+        return L;
+    }
+
+    Vector3f getSplat(int index) const {
+        return Vector3f(splat[3 * index], splat[3 * index + 1], splat[3 * index + 2]);
+    }
+
+    // 线程安全地累加splat（对每个分量做CAS循环，不加锁）
+    void addSplat(int index, const Vector3f &L) {
+        atomicAdd(splat[3 * index], L.x);
+        atomicAdd(splat[3 * index + 1], L.y);
+        atomicAdd(splat[3 * index + 2], L.z);
+    }
+
+    // 合并另一张胶片：累加和与采样数直接相加，结果等价于按采样数加权平均
+    void merge(const Film &other) {
+        for (size_t i = 0; i < radiance.size(); ++i) {
+            radiance[i] += other.radiance[i];
+            sampleCount[i] += other.sampleCount[i];
+            luminanceSq[i] += other.luminanceSq[i];
+        }
+        for (size_t i = 0; i < splat.size(); ++i) atomicAdd(splat[i], other.splat[i]);
+        lightPaths += other.lightPaths;
+    }
+
+    // 输出图片（gamma校正后量化到8bit）
+    void writePPM(const std::string &filename) const;
+    static void writePPM(const std::string &filename, int width, int height, const std::vector<Vector3f> &pixels);
+
+    // 以二进制形式保存/读取累加缓冲、采样数和文件头
+    bool save(const std::string &filename, const FilmHeader &header) const;
+    bool load(const std::string &filename, FilmHeader &header);
+
+private:
+    static void atomicAdd(std::atomic<float> &a, float v) {
+        if (v == 0.f) return;
+        float old = a.load(std::memory_order_relaxed);
+        while (!a.compare_exchange_weak(old, old + v, std::memory_order_relaxed)) {}
+    }
+};
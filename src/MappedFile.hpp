@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// 只读的内存映射文件：_WIN32下用CreateFileMapping/MapViewOfFile，其他平台用mmap
+// 映射后不复制数据，页面在第一次访问时才由系统读入
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &filename);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool valid() const { return data != nullptr; }
+    const char* getData() const { return data; }
+    size_t getSize() const { return size; }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void *file = nullptr, *mapping = nullptr; // HANDLE
+#else
+    int fd = -1;
+#endif
+};
@@ -11,12 +11,12 @@ public:
     ~Diffuse() = default;
 };
 
-Diffuse::Diffuse(Vector3f kd, Vector3f e) : Material(DIFFUSE, e){
+inline Diffuse::Diffuse(Vector3f kd, Vector3f e) : Material(DIFFUSE, e){
     this->Kd = kd;
 }
 
 // refer: pbrt
-Vector3f Diffuse::sample(const Vector3f &wo, const Vector3f &N){
+inline Vector3f Diffuse::sample(const Vector3f &wo, const Vector3f &N){
     // uniform sample on the hemisphere
     // float x_1 = get_random_float(), x_2 = get_random_float();
     // float z = std::fabs(1.0f - 2.0f * x_1); // 随机半球方向的z轴坐标，z在[0,1]之间
@@ -45,7 +45,7 @@ Vector3f Diffuse::sample(const Vector3f &wo, const Vector3f &N){
     
 }
 
-float Diffuse::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
+inline float Diffuse::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
     // // uniform sample probability 1 / (2 * PI)
     // if (dotProduct(wi, N) > 0.0f)
     //     return 0.5f / M_PI;
@@ -58,7 +58,7 @@ float Diffuse::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
         return 0.0f;
 }
 
-Vector3f Diffuse::eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N, const Vector2f &tcoord){
+inline Vector3f Diffuse::eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N, const Vector2f &tcoord){
     float cosalpha_i = dotProduct(N, wi);
     float cosalpha_o = dotProduct(N, wo);
     if (cosalpha_i > 0.0f && cosalpha_o > 0.0f) {
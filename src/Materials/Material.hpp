@@ -1,11 +1,18 @@
 #pragma once
 
+#include <memory>
+#include <cstdint>
+
 #include "Vector.hpp"
 #include "global.hpp"
 #include "Texture.hpp"
 
 enum MaterialType {DIFFUSE, MIRROR, MICROFACET, TRANSPARENT}; // 待扩展
 
+// 材质在场景材质表（MaterialTable）中的编号
+using MaterialId = uint16_t;
+const MaterialId NO_MATERIAL = 0xffff;
+
 class Material{
 protected:
     // Compute reflection direction
@@ -80,11 +87,12 @@ public:
     MaterialType m_type;
     //Vector3f m_color;
     Vector3f m_emission;
-    float ior;
+    float ior = 1.f; // 不是每种材质都会设置ior和roughness，给出默认值以便材质表统一编译
     Vector3f Kd, Ks;
-    float specularExponent;
-    float roughness;
+    float specularExponent = 0.f;
+    float roughness = 0.f;
     std::unique_ptr<Texture> texture_color;
+    MaterialId id = NO_MATERIAL; // 在最近一次编译它的场景材质表中的编号，由MaterialTable::add分配
 
     //inline Material(MaterialType t = DIFFUSE, Vector3f e = Vector3f(0.f), float r = 1.0f);
     inline Material(MaterialType t = DIFFUSE, Vector3f e = Vector3f(0.f));
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <vector>
+#include <cassert>
+#include "Material.hpp"
+
+// 扁平的材质表：每个材质编译为一条紧凑的带类型标签的记录，按材质编号索引
+// 着色时按标签switch（或在批量着色中按类型实例化模板）到内联的BRDF，不经过虚函数；
+// roughness^2、F0、Kd / pi等常数在build时算好，有纹理时F0和漫反射项按纹理颜色计算
+// 材质表属于场景（Scene::materials），每次Scene::buildBVH时只用场景中物体的材质重新生成，
+// 因此不会保存已经释放的临时材质
+struct MaterialRecord
+{
+    MaterialType type;
+    float roughness, alpha2; // GGX的alpha（= roughness）及其平方
+    float ior;
+    Vector3f F0; // Schlick近似的F0（材质颜色）
+    Vector3f diffuse; // 材质颜色 / pi
+    const Texture *texture; // 为空时没有纹理
+};
+
+class MaterialTable
+{
+public:
+    void clear()
+    {
+        materials.clear();
+        records.clear();
+    }
+
+    // 为材质分配编号，已在表中时直接返回；m为空时返回NO_MATERIAL
+    // 材质的编号保存在材质上，同一材质被另一个场景的表编号后，在这个表中视为未编号
+    MaterialId add(Material *m)
+    {
+        if (!m) return NO_MATERIAL;
+        if (!contains(m)) {
+            assert(materials.size() < NO_MATERIAL);
+            m->id = (MaterialId)materials.size();
+            materials.push_back(m);
+        }
+        return m->id;
+    }
+
+    // 编译所有已编号材质的记录，材质参数或纹理改变后需要重新调用
+    void build()
+    {
+        records.resize(materials.size());
+        for (size_t i = 0; i < materials.size(); ++i) {
+            Material *m = materials[i];
+            MaterialRecord &r = records[i];
+            r.type = m->getType();
+            r.roughness = m->roughness;
+            r.alpha2 = m->roughness * m->roughness;
+            r.ior = m->ior;
+            r.F0 = m->Kd;
+            r.diffuse = m->Kd / M_PI;
+            r.texture = m->texture_color.get();
+        }
+    }
+
+    Material *material(MaterialId id) const {return id == NO_MATERIAL ? nullptr : materials[id];}
+    // 材质在这个表中且已编译时返回true，否则只能调用虚函数
+    bool compiled(const Material *m) const {return m->id < records.size() && materials[m->id] == m;}
+    const MaterialRecord &record(MaterialId id) const {return records[id];}
+
+private:
+    bool contains(const Material *m) const {return m->id < materials.size() && materials[m->id] == m;}
+
+    // 不拥有材质：材质属于场景中的物体，生命周期需要覆盖整个渲染过程
+    std::vector<Material*> materials;
+    std::vector<MaterialRecord> records;
+};
+
+// 记录的材质颜色，与Material::getColorAt相同：没有纹理或没有纹理坐标时为Kd
+inline Vector3f colorAt(const MaterialRecord &r, const Vector2f &tcoord)
+{
+    if (!r.texture || tcoord.x < 0 || tcoord.y < 0) return r.F0;
+    return r.texture->getColor(tcoord.x, tcoord.y);
+}
+
+inline Vector3f localToWorld(const Vector3f &a, const Vector3f &N)
+{
+    Vector3f B, C;
+    CoordinateSystem(N, B, C);
+    return a.x * B + a.y * C + a.z * N;
+}
+
+// 与各材质类的sample/pdf/eval结果相同（随机数的使用顺序也相同）
+// wo出射，wi入射（均朝外），N为归一化的法线
+template<MaterialType T>
+inline Vector3f sampleBSDF(const MaterialRecord &r, const Vector3f &wo, const Vector3f &N)
+{
+    if constexpr (T == DIFFUSE) {
+        // 针对disk的concentric采样，再投影至半球上
+        float random_x = get_random_float(), random_y = get_random_float();
+        Vector2f point = Vector2f(random_x, random_y) * 2.f + Vector2f(-1.f);
+        if (point.x == 0 && point.y == 0) return N;
+        float theta, radius;
+        if (std::fabs(point.x) > std::fabs(point.y)) {
+            radius = point.x;
+            theta = (M_PI / 4) * (point.y / point.x);
+        } else {
+            radius = point.y;
+            theta = (M_PI / 2) - (M_PI / 4) * (point.x / point.y);
+        }
+        point = Vector2f(radius * std::cos(theta), radius * std::sin(theta));
+        float z = std::sqrt(std::max(0.f, 1 - point.x * point.x - point.y * point.y));
+        return localToWorld(Vector3f(point.x, point.y, z), N);
+    } else if constexpr (T == MICROFACET) {
+        // 按GGX的D(h)cos(h)采样半向量：tan^2(theta) = alpha^2 * u / (1 - u)
+        float random_phi = get_random_float(), random_theta = get_random_float();
+        float phi = 2 * M_PI * random_phi;
+        float tan2 = r.alpha2 * random_theta / (1 - random_theta);
+        float costheta = 1 / std::sqrt(1 + tan2), sintheta = std::sqrt(std::max(0.f, 1 - costheta * costheta));
+        Vector3f wh = normalize(localToWorld(Vector3f(sintheta * std::cos(phi), sintheta * std::sin(phi), costheta), N));
+        return 2 * dotProduct(wo, wh) * wh - wo;
+    } else if constexpr (T == MIRROR) {
+        return 2 * dotProduct(wo, N) * N - wo;
+    } else {
+        return Vector3f(0.f); // 透明材质只用于whitted-style
+    }
+}
+
+template<MaterialType T>
+inline float pdfBSDF(const MaterialRecord &r, const Vector3f &wi, const Vector3f &wo, const Vector3f &N)
+{
+    float cosi = dotProduct(wi, N), coso = dotProduct(wo, N);
+    if (!(cosi > 0.f && coso > 0.f)) return 0.f;
+    if constexpr (T == DIFFUSE) {
+        return cosi / M_PI;
+    } else if constexpr (T == MICROFACET) {
+        Vector3f wh = normalize(wi + wo);
+        float costheta_h = dotProduct(wh, N);
+        if (r.roughness <= 0.f && costheta_h >= 1.f) return 1.f; // 防止0/0的情况
+        float d = (r.alpha2 - 1) * costheta_h * costheta_h + 1;
+        return r.alpha2 * costheta_h / (M_PI * d * d) / (4.f * dotProduct(wo, wh));
+    } else if constexpr (T == MIRROR) {
+        return 1.f;
+    } else {
+        return 0.f;
+    }
+}
+
+template<MaterialType T>
+inline Vector3f evalBSDF(const MaterialRecord &r, const Vector3f &wi, const Vector3f &wo, const Vector3f &N, const Vector2f &tcoord)
+{
+    float cosi = dotProduct(N, wi), coso = dotProduct(N, wo);
+    if (!(cosi > 0.f && coso > 0.f)) return Vector3f(0.f);
+    // Schlick近似，F0为材质颜色
+    auto schlick = [&](const Vector3f &F0) {
+        float c = 1 - coso, c2 = c * c;
+        return F0 + (Vector3f(1.f) - F0) * (c2 * c2 * c);
+    };
+    if constexpr (T == DIFFUSE) {
+        return r.texture ? colorAt(r, tcoord) / M_PI : r.diffuse;
+    } else if constexpr (T == MICROFACET) {
+        Vector3f color = r.texture ? colorAt(r, tcoord) : r.F0;
+        Vector3f F = schlick(color);
+        // Smith几何项，tan^2 = (1 - cos^2) / cos^2
+        auto lambda = [&](float c) { return (-1 + std::sqrt(1 + r.alpha2 * (1 - c * c) / (c * c))) / 2; };
+        float G = 1 / (1 + lambda(cosi) + lambda(coso));
+        // GGX法线分布项
+        float costheta_h = dotProduct(N, normalize(wi + wo)), D;
+        if (costheta_h <= 0.f) D = 0.f;
+        else if (r.roughness <= 0.f && costheta_h >= 1.f) D = 4 * coso; // 镜面下D项为4*costheta_o*delta函数
+        else {
+            float d = (r.alpha2 - 1) * costheta_h * costheta_h + 1;
+            D = r.alpha2 / (M_PI * d * d);
+        }
+        Vector3f fm = F * (G * D / (4 * cosi * coso));
+        Vector3f fd = (Vector3f(1.f) - F) * (r.texture ? color / M_PI : r.diffuse);
+        return fd + fm;
+    } else if constexpr (T == MIRROR) {
+        // 不是镜面反射方向时为0
+        Vector3f c = crossProduct(wi + wo, N);
+        if (dotProduct(c, c) >= EPSILON * EPSILON) return Vector3f(0.f);
+        return schlick(colorAt(r, tcoord)) / cosi;
+    } else {
+        return Vector3f(0.f);
+    }
+}
+
+inline Vector3f sampleBSDF(const MaterialRecord &r, const Vector3f &wo, const Vector3f &N)
+{
+    switch (r.type) {
+        case DIFFUSE: return sampleBSDF<DIFFUSE>(r, wo, N);
+        case MICROFACET: return sampleBSDF<MICROFACET>(r, wo, N);
+        case MIRROR: return sampleBSDF<MIRROR>(r, wo, N);
+        default: return Vector3f(0.f);
+    }
+}
+
+inline float pdfBSDF(const MaterialRecord &r, const Vector3f &wi, const Vector3f &wo, const Vector3f &N)
+{
+    switch (r.type) {
+        case DIFFUSE: return pdfBSDF<DIFFUSE>(r, wi, wo, N);
+        case MICROFACET: return pdfBSDF<MICROFACET>(r, wi, wo, N);
+        case MIRROR: return pdfBSDF<MIRROR>(r, wi, wo, N);
+        default: return 0.f;
+    }
+}
+
+inline Vector3f evalBSDF(const MaterialRecord &r, const Vector3f &wi, const Vector3f &wo, const Vector3f &N, const Vector2f &tcoord)
+{
+    switch (r.type) {
+        case DIFFUSE: return evalBSDF<DIFFUSE>(r, wi, wo, N, tcoord);
+        case MICROFACET: return evalBSDF<MICROFACET>(r, wi, wo, N, tcoord);
+        case MIRROR: return evalBSDF<MIRROR>(r, wi, wo, N, tcoord);
+        default: return Vector3f(0.f);
+    }
+}
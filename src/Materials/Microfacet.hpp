@@ -12,7 +12,7 @@ public:
     virtual ~Microfacet() = default;
 };
 
-Microfacet::Microfacet(Vector3f kd, float r, Vector3f e) : Material(MICROFACET, e){
+inline Microfacet::Microfacet(Vector3f kd, float r, Vector3f e) : Material(MICROFACET, e){
     this->Kd = kd;
     this->roughness = clamp(0.f, 1.f, r);
 }
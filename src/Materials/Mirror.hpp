@@ -11,22 +11,22 @@ public:
     ~Mirror() = default;
 };
 
-Mirror::Mirror(const float ior, Vector3f e) : Material(MIRROR, e){
+inline Mirror::Mirror(const float ior, Vector3f e) : Material(MIRROR, e){
     this->ior = ior;
 }
 
-Vector3f Mirror::sample(const Vector3f &wo, const Vector3f &N){
+inline Vector3f Mirror::sample(const Vector3f &wo, const Vector3f &N){
     return -reflect(wo, N);
 }
 
-float Mirror::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
+inline float Mirror::pdf(const Vector3f &wi, const Vector3f &wo, const Vector3f &N){
     if(dotProduct(wi, N) > 0.0f && dotProduct(wo, N) > 0.0f)
         return 1.0f;
     else 
         return 0.0f;
 }
 
-Vector3f Mirror::eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N, const Vector2f &tcoord){
+inline Vector3f Mirror::eval(const Vector3f &wi, const Vector3f &wo, const Vector3f &N, const Vector2f &tcoord){
     float cosalpha_i = dotProduct(N, wi);
     float cosalpha_o = dotProduct(N, wo);
     Vector3f kr; // 返回的Fresnel系数
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include "Material.hpp"
+#include "MaterialTable.hpp"
+
+// 非虚函数的材质分派：查场景材质表中的记录后switch到内联的BRDF（见MaterialTable.hpp）
+// 材质不在表中（未经Scene::buildBVH编译）时退回虚函数
+inline Vector3f sampleMaterial(const MaterialTable &table, Material *m, const Vector3f &wo, const Vector3f &N)
+{
+    if (!table.compiled(m)) return m->getType() == TRANSPARENT ? Vector3f(0.f) : m->sample(wo, N);
+    return sampleBSDF(table.record(m->id), wo, N);
+}
+
+inline float pdfMaterial(const MaterialTable &table, Material *m, const Vector3f &wi, const Vector3f &wo, const Vector3f &N)
+{
+    if (!table.compiled(m)) return m->getType() == TRANSPARENT ? 0.f : m->pdf(wi, wo, N);
+    return pdfBSDF(table.record(m->id), wi, wo, N);
+}
+
+inline Vector3f evalMaterial(const MaterialTable &table, Material *m, const Vector3f &wi, const Vector3f &wo, const Vector3f &N, const Vector2f &tcoord)
+{
+    if (!table.compiled(m)) return m->getType() == TRANSPARENT ? Vector3f(0.f) : m->eval(wi, wo, N, tcoord);
+    return evalBSDF(table.record(m->id), wi, wo, N, tcoord);
+}
+
+// 批量着色：收集一批着色点，按材质编号（纹理属于材质，同一材质即同一张纹理）分组，
+// 每组用按材质类型实例化的循环一次处理完，循环内没有分支分派，材质记录和纹理在组内不变
+// 加入的材质需要已在table中编译
+// 用法：clear() -> add()若干次 -> sample(table)或eval(table) -> 读取wi/f/pdf
+struct ShadingBatch
+{
+    std::vector<MaterialId> material;
+    std::vector<Vector3f> wo, N; // 出射方向（朝外），归一化的法线
+    std::vector<Vector2f> tcoords;
+    std::vector<Vector3f> wi; // eval的输入 / sample的输出（归一化的入射方向，朝外）
+    std::vector<Vector3f> f; // 输出：brdf
+    std::vector<float> pdf; // 输出：wi的立体角pdf
+    int size = 0;
+
+    void clear() { size = 0; }
+
+    // 返回在批中的下标
+    int add(Material *m, const Vector3f &wo_, const Vector3f &N_, const Vector2f &tcoord, const Vector3f &wi_ = Vector3f(0.f))
+    {
+        if ((int)material.size() <= size) {
+            int n = std::max(16, 2 * size);
+            material.resize(n); wo.resize(n); N.resize(n); tcoords.resize(n);
+            wi.resize(n); f.resize(n); pdf.resize(n);
+        }
+        material[size] = m->id; wo[size] = wo_; N[size] = N_; tcoords[size] = tcoord; wi[size] = wi_;
+        return size++;
+    }
+
+    // 对每个着色点采样入射方向wi，并计算f和pdf
+    void sample(const MaterialTable &table) { dispatch(table, true); }
+
+    // 对给定的wi计算f和pdf
+    void eval(const MaterialTable &table) { dispatch(table, false); }
+
+private:
+    std::vector<MaterialId> groupMaterial; // 每组的材质
+    std::vector<int> group; // 每个着色点所在的组
+    std::vector<int> groupBegin; // 第g组在order中的范围是[groupBegin[g], groupBegin[g + 1])
+    std::vector<int> groupNext;
+    std::vector<int> order; // 按材质分组后的下标
+
+    template<MaterialType T>
+    void kernel(const MaterialRecord &r, const int *index, int count, bool sampling)
+    {
+        for (int k = 0; k < count; ++k) {
+            int i = index[k];
+            if (sampling) wi[i] = normalize(sampleBSDF<T>(r, wo[i], N[i]));
+            pdf[i] = pdfBSDF<T>(r, wi[i], wo[i], N[i]);
+            f[i] = evalBSDF<T>(r, wi[i], wo[i], N[i], tcoords[i]);
+        }
+    }
+
+    void dispatch(const MaterialTable &table, bool sampling)
+    {
+        // 按材质第一次出现的顺序编组，再做计数排序；组内保持加入顺序
+        groupMaterial.clear();
+        group.resize(size);
+        for (int i = 0; i < size; ++i) {
+            int g = 0;
+            while (g < (int)groupMaterial.size() && groupMaterial[g] != material[i]) ++g;
+            if (g == (int)groupMaterial.size()) groupMaterial.push_back(material[i]);
+            group[i] = g;
+        }
+        groupBegin.assign(groupMaterial.size() + 1, 0);
+        for (int i = 0; i < size; ++i) groupBegin[group[i] + 1]++;
+        for (size_t g = 0; g < groupMaterial.size(); ++g) groupBegin[g + 1] += groupBegin[g];
+        order.resize(size);
+        groupNext.assign(groupBegin.begin(), groupBegin.end() - 1);
+        for (int i = 0; i < size; ++i) order[groupNext[group[i]]++] = i;
+
+        for (size_t g = 0; g < groupMaterial.size(); ++g) {
+            const MaterialRecord &r = table.record(groupMaterial[g]);
+            const int *index = order.data() + groupBegin[g];
+            int count = groupBegin[g + 1] - groupBegin[g];
+            switch (r.type) {
+                case DIFFUSE: kernel<DIFFUSE>(r, index, count, sampling); break;
+                case MICROFACET: kernel<MICROFACET>(r, index, count, sampling); break;
+                case MIRROR: kernel<MIRROR>(r, index, count, sampling); break;
+                default: // 透明材质只用于whitted-style
+                    for (int k = 0; k < count; ++k) {
+                        if (sampling) wi[index[k]] = Vector3f(0.f);
+                        f[index[k]] = Vector3f(0.f);
+                        pdf[index[k]] = 0.f;
+                    }
+                    break;
+            }
+        }
+    }
+};
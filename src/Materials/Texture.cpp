@@ -44,4 +44,13 @@ Vector3f Texture::getColor(float u, float v) const
     // auto color = color_texture.at<cv::Vec3b>(v_img, u_img);
     // auto color = data + (v_img * width + u_img) * channel;
     // return Vector3f(color[0], color[1], color[2]) / 255.f;
-}
\ No newline at end of file
+}
+
+uint64_t Texture::hash(uint64_t h) const
+{
+    h = hash_bytes(&width, sizeof(width), h);
+    h = hash_bytes(&height, sizeof(height), h);
+    // stbi_load按3个通道读取（channel返回的是文件中的通道数）
+    if (data) h = hash_bytes(data, (size_t)width * height * 3, h);
+    return h;
+}
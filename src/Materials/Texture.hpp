@@ -8,6 +8,8 @@ public:
     Texture(const std::string& name);
     virtual ~Texture();
     Vector3f getColor(float u, float v) const;
+    // 把纹理的尺寸和像素混入哈希h，用于校验断点与场景是否一致
+    uint64_t hash(uint64_t h) const;
 private:
     // cv::Mat color_texture;
     unsigned char* data;
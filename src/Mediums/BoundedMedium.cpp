@@ -0,0 +1,144 @@
+#include <cmath>
+#include <atomic>
+#include <iostream>
+#include <algorithm>
+#include "BoundedMedium.hpp"
+
+BoundedMedium::BoundedMedium(std::unique_ptr<Medium> inner, const Bounds3 &box)
+    : Medium(inner->getType(), inner->pf), medium(std::move(inner)), box(box) {}
+
+BoundedMedium::BoundedMedium(std::unique_ptr<Medium> inner, Object *mesh)
+    : Medium(inner->getType(), inner->pf), medium(std::move(inner)), box(mesh->getBounds()), mesh(mesh) {}
+
+bool BoundedMedium::intersect(const Ray &ray, const float &tMax, float &t0, float &t1) const
+{
+    return clipToBox(box, ray, tMax, t0, t1);
+}
+
+uint64_t BoundedMedium::hash(uint64_t h) const
+{
+    h = hash_bytes(&box, sizeof(box), h);
+    if (mesh) {
+        float area = mesh->getArea();
+        h = hash_bytes(&area, sizeof(area), h);
+    }
+    return medium->hash(h);
+}
+
+// 光线从t处继续与网格求交，返回下一个交点的距离，没有交点时返回false
+static bool nextCrossing(Object *mesh, const Ray &ray, float &t, Vector3f &normal)
+{
+    Intersection hit = mesh->getIntersection(Ray(ray(t), ray.direction));
+    if (!hit.happened) return false;
+    t += hit.distance;
+    normal = hit.normal;
+    return true;
+}
+
+// 越过交点继续求交
+static float skipCrossing(float t)
+{
+    return t + std::max(EPSILON, t * 1e-5f);
+}
+
+template<typename Callback>
+void BoundedMedium::intervals(const Ray &ray, float tMax, const Callback &callback) const
+{
+    float t0, t1;
+    if (!intersect(ray, tMax, t0, t1)) return;
+    if (!mesh) {
+        callback(t0, t1);
+        return;
+    }
+    // tMax之前的交点存入crossings（存满后之后的交点在输出区间时重新求），tMax之后的交点只计数，
+    // 交点总数为奇数说明起点在网格内部
+    float crossings[MAX_CROSSINGS];
+    int stored = 0, count = 0;
+    bool overflow = false;
+    float t = 0.f;
+    Vector3f normal, firstNormal;
+    while (count < MAX_PARITY_CROSSINGS && nextCrossing(mesh, ray, t, normal)) {
+        if (count == 0) firstNormal = normal;
+        if (t < tMax) {
+            if (stored < MAX_CROSSINGS) crossings[stored++] = t;
+            else overflow = true;
+        }
+        ++count;
+        t = skipCrossing(t);
+    }
+    bool inside = count % 2 == 1;
+    if (count == MAX_PARITY_CROSSINGS) {
+        // 交点过多时奇偶性不可靠，改由第一个交点处法线的朝向判断（要求网格的法线朝外）
+        static std::atomic<bool> warned(false);
+        if (!warned.exchange(true))
+            std::cerr << "Warning: ray crosses the medium boundary mesh more than " << MAX_PARITY_CROSSINGS
+                      << " times, using the facing of the first crossing instead\n";
+        inside = dotProduct(firstNormal, ray.direction) > 0.f;
+    }
+
+    float start = 0.f;
+    auto cross = [&](float tc) {
+        bool keepGoing = !inside || callback(start, tc);
+        start = tc;
+        inside = !inside;
+        return keepGoing;
+    };
+    for (int i = 0; i < stored; ++i)
+        if (!cross(crossings[i])) return;
+    if (overflow) {
+        t = skipCrossing(crossings[stored - 1]);
+        while (nextCrossing(mesh, ray, t, normal) && t < tMax) {
+            if (!cross(t)) return;
+            t = skipCrossing(t);
+        }
+    }
+    if (inside) callback(start, tMax);
+}
+
+// 各区间上内部介质的透射率之积
+float BoundedMedium::Tr(const Ray &ray, const float &tMax)
+{
+    float T = 1.f;
+    intervals(ray, tMax, [&](float a, float b) {
+        T *= medium->Tr(Ray(ray(a), ray.direction), b - a);
+        return T > 0.f;
+    });
+    return T;
+}
+
+// 依次在各区间上采样，碰撞过程无记忆，区间之间的真空不影响分布
+float BoundedMedium::sample(const Ray &ray, const float &tMax, float &weight)
+{
+    float result = tMax;
+    intervals(ray, tMax, [&](float a, float b) {
+        float t = medium->sample(Ray(ray(a), ray.direction), b - a, weight);
+        if (t < b - a) {
+            result = a + t;
+            return false;
+        }
+        return true;
+    });
+    if (result >= tMax) weight = 1.f;
+    return result;
+}
+
+float BoundedMedium::pdf(const Ray &ray, const float &t, float &albedo)
+{
+    // 收集[0, t]内的区间：之前各区间的透射率之积，以及最后一个区间
+    float T = 1.f, lastStart = 0.f, lastEnd = -1.f;
+    intervals(ray, t, [&](float a, float b) {
+        if (lastEnd >= 0.f) T *= medium->Tr(Ray(ray(lastStart), ray.direction), lastEnd - lastStart);
+        lastStart = a;
+        lastEnd = b;
+        return true;
+    });
+    albedo = 0.f;
+    // 内部介质不能解析计算时，透射率也只能估计，直接返回
+    float last = medium->pdf(Ray(ray(lastStart), ray.direction), std::max(0.f, t - lastStart), albedo);
+    if (last < 0.f) return -1.f;
+    if (lastEnd < t) {
+        albedo = 0.f;
+        return 0.f;
+    }
+    return last * T;
+}
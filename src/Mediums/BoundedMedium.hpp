@@ -0,0 +1,40 @@
+#ifndef BOUNDEDMEDIUM_HPP
+#define BOUNDEDMEDIUM_HPP
+
+#include <memory>
+#include "Medium.hpp"
+#include "Object.hpp"
+
+// 有边界的介质：内部介质只存在于包围盒或闭合网格的内部，外部为真空
+// 沿光线求出进入/离开边界的位置（网格按交点个数的奇偶判断起点是否在内部），只在内部的区间上调用内部介质的
+// 距离采样和透射率；不与边界包围盒相交的光线只需要一次包围盒测试
+class BoundedMedium : public Medium{
+public:
+    BoundedMedium(std::unique_ptr<Medium> medium, const Bounds3 &box);
+    // mesh为闭合网格，只用作边界，不需要加入场景
+    BoundedMedium(std::unique_ptr<Medium> medium, Object *mesh);
+    ~BoundedMedium() = default;
+
+    // 与边界包围盒的交（对网格是保守的）
+    bool intersect(const Ray &ray, const float &tMax, float &t0, float &t1) const override;
+    float Tr(const Ray &ray, const float &tMax) override;
+    float sample(const Ray &ray, const float &tMax, float &weight) override;
+    // t在边界内部时为内部介质在所在区间上的pdf乘以之前各区间的透射率，在外部时为0
+    float pdf(const Ray &ray, const float &t, float &albedo) override;
+    // 边界（包围盒，网格时另加网格的面积）和内部介质
+    uint64_t hash(uint64_t h) const override;
+
+private:
+    static const int MAX_CROSSINGS = 32; // 一次存下的tMax之前的交点数，更多的交点在输出区间时重新求
+    static const int MAX_PARITY_CROSSINGS = 4096; // 判断起点是否在内部时最多求的交点数
+
+    std::unique_ptr<Medium> medium;
+    Bounds3 box; // 网格时为网格的包围盒
+    Object *mesh = nullptr;
+
+    // 按顺序对ray上[0, tMax)位于边界内部的每个区间[a, b]调用callback(a, b)，callback返回false时停止
+    template<typename Callback>
+    void intervals(const Ray &ray, float tMax, const Callback &callback) const;
+};
+
+#endif
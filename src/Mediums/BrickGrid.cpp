@@ -0,0 +1,154 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <iostream>
+#include "BrickGrid.hpp"
+#include "VoxelGrid.hpp"
+
+static_assert(sizeof(BrickGrid::BrickHeader) == 96, "BrickHeader must match the file layout");
+
+static const char BRICK_MAGIC[8] = {'M', 'P', 'T', 'B', 'R', 'I', 'C', 'K'};
+
+BrickGrid::BrickGrid(std::unique_ptr<MappedFile> mapped, const BrickHeader &header)
+    : DensityGrid(Bounds3(Vector3f(header.bounds[0], header.bounds[1], header.bounds[2]),
+                          Vector3f(header.bounds[3], header.bounds[4], header.bounds[5])),
+                  header.resolution[0], header.resolution[1], header.resolution[2]),
+      file(std::move(mapped)), bricks{header.bricks[0], header.bricks[1], header.bricks[2]}, shift(0), brickCount(header.brickCount)
+{
+    while ((1u << shift) < header.brickSize) ++shift;
+    const char *base = file->getData();
+    index = reinterpret_cast<const int32_t*>(base + header.indexOffset);
+    range = reinterpret_cast<const float*>(base + header.rangeOffset);
+    data = reinterpret_cast<const float*>(base + header.dataOffset);
+}
+
+std::unique_ptr<BrickGrid> BrickGrid::load(const std::string &filename)
+{
+    auto file = std::make_unique<MappedFile>(filename);
+    if (!file->valid()) {
+        std::cerr << "Cannot map " << filename << "\n";
+        return nullptr;
+    }
+    BrickHeader header;
+    bool ok = file->getSize() >= sizeof(BrickHeader);
+    if (ok) {
+        std::memcpy(&header, file->getData(), sizeof(BrickHeader));
+        uint32_t B = header.brickSize;
+        ok = std::memcmp(header.magic, BRICK_MAGIC, 8) == 0 && header.version == VERSION && B > 0 && B <= 64 && (B & (B - 1)) == 0;
+        for (int axis = 0; ok && axis < 3; ++axis)
+            ok = header.resolution[axis] > 0 && header.bricks[axis] == (int32_t)((header.resolution[axis] + B - 1) / B);
+        if (ok) {
+            uint64_t indexCount = (uint64_t)header.bricks[0] * header.bricks[1] * header.bricks[2];
+            uint64_t voxelsPerBrick = (uint64_t)B * B * B;
+            // 各段按4字节对齐并完整落在文件内
+            ok = header.indexOffset % 4 == 0 && header.rangeOffset % 4 == 0 && header.dataOffset % 4 == 0
+              && header.indexOffset + indexCount * sizeof(int32_t) <= file->getSize()
+              && header.rangeOffset + header.brickCount * 2 * sizeof(float) <= file->getSize()
+              && header.dataOffset + header.brickCount * voxelsPerBrick * sizeof(float) <= file->getSize();
+            // 索引必须指向已存储的块，保证查询时不越界
+            const int32_t *index = ok ? reinterpret_cast<const int32_t*>(file->getData() + header.indexOffset) : nullptr;
+            for (uint64_t i = 0; ok && i < indexCount; ++i)
+                ok = index[i] >= -1 && index[i] < (int64_t)header.brickCount;
+        }
+    }
+    if (!ok) {
+        std::cerr << "Invalid brick volume " << filename << "\n";
+        return nullptr;
+    }
+    return std::unique_ptr<BrickGrid>(new BrickGrid(std::move(file), header));
+}
+
+bool BrickGrid::write(const std::string &filename, const VoxelGrid &grid, int brickSize)
+{
+    if (brickSize <= 0 || (brickSize & (brickSize - 1)) != 0) {
+        std::cerr << "Brick size must be a power of two\n";
+        return false;
+    }
+    BrickHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, BRICK_MAGIC, 8);
+    header.version = VERSION;
+    header.brickSize = brickSize;
+    for (int axis = 0; axis < 3; ++axis) {
+        header.resolution[axis] = grid.resolution(axis);
+        header.bricks[axis] = (grid.resolution(axis) + brickSize - 1) / brickSize;
+    }
+    const Bounds3 &b = grid.getBounds();
+    float bounds[6] = {b.pMin.x, b.pMin.y, b.pMin.z, b.pMax.x, b.pMax.y, b.pMax.z};
+    std::memcpy(header.bounds, bounds, sizeof(bounds));
+
+    // 第一遍：每块的最小/最大密度，决定哪些块需要存储
+    size_t indexCount = (size_t)header.bricks[0] * header.bricks[1] * header.bricks[2];
+    std::vector<int32_t> index(indexCount, -1);
+    std::vector<float> range;
+    auto forBrick = [&](int bx, int by, int bz, const auto &f) {
+        for (int z = 0; z < brickSize; ++z) for (int y = 0; y < brickSize; ++y) for (int x = 0; x < brickSize; ++x) {
+            int vx = bx * brickSize + x, vy = by * brickSize + y, vz = bz * brickSize + z;
+            bool inside = vx < header.resolution[0] && vy < header.resolution[1] && vz < header.resolution[2];
+            f(inside ? grid.voxel(vx, vy, vz) : 0.f); // 边缘块超出分辨率的部分补0
+        }
+    };
+    for (int bz = 0; bz < header.bricks[2]; ++bz) for (int by = 0; by < header.bricks[1]; ++by) for (int bx = 0; bx < header.bricks[0]; ++bx) {
+        float lo = kInfinity, hi = 0.f;
+        forBrick(bx, by, bz, [&](float v) { lo = std::min(lo, v); hi = std::max(hi, v); });
+        if (hi <= 0.f) continue;
+        index[(bz * header.bricks[1] + by) * header.bricks[0] + bx] = (int32_t)header.brickCount++;
+        range.push_back(lo);
+        range.push_back(hi);
+    }
+    header.indexOffset = sizeof(BrickHeader);
+    header.rangeOffset = header.indexOffset + indexCount * sizeof(int32_t);
+    header.dataOffset = header.rangeOffset + range.size() * sizeof(float);
+
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        std::cerr << "Cannot open " << filename << " for writing\n";
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(index.data(), sizeof(int32_t), index.size(), fp);
+    fwrite(range.data(), sizeof(float), range.size(), fp);
+    // 第二遍：按编号顺序写出有数据的块
+    std::vector<float> brick;
+    brick.reserve((size_t)brickSize * brickSize * brickSize);
+    for (int bz = 0; bz < header.bricks[2]; ++bz) for (int by = 0; by < header.bricks[1]; ++by) for (int bx = 0; bx < header.bricks[0]; ++bx) {
+        if (index[(bz * header.bricks[1] + by) * header.bricks[0] + bx] < 0) continue;
+        brick.clear();
+        forBrick(bx, by, bz, [&](float v) { brick.push_back(v); });
+        fwrite(brick.data(), sizeof(float), brick.size(), fp);
+    }
+    bool ok = !ferror(fp);
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) std::cerr << "Failed to write " << filename << "\n";
+    return ok;
+}
+
+uint64_t BrickGrid::hash(uint64_t h) const
+{
+    h = DensityGrid::hash(h);
+    h = hash_bytes(&shift, sizeof(shift), h);
+    h = hash_bytes(index, (size_t)bricks[0] * bricks[1] * bricks[2] * sizeof(int32_t), h);
+    return hash_bytes(range, (size_t)brickCount * 2 * sizeof(float), h);
+}
+
+float BrickGrid::density(const Vector3f &p) const
+{
+    return interpolate(p, [this](int x, int y, int z) {return voxel(x, y, z);});
+}
+
+// 用到的体素所在各块的最小/最大密度，空块为0
+void BrickGrid::densityRange(const Vector3f &lo, const Vector3f &hi, float &minDensity, float &maxDensity) const
+{
+    int i0[3], i1[3];
+    voxelRange(lo, hi, i0, i1);
+    minDensity = kInfinity;
+    maxDensity = 0.f;
+    for (int bz = i0[2] >> shift; bz <= i1[2] >> shift; ++bz)
+        for (int by = i0[1] >> shift; by <= i1[1] >> shift; ++by)
+            for (int bx = i0[0] >> shift; bx <= i1[0] >> shift; ++bx) {
+                int b = index[(bz * bricks[1] + by) * bricks[0] + bx];
+                minDensity = std::min(minDensity, b < 0 ? 0.f : range[2 * b]);
+                maxDensity = std::max(maxDensity, b < 0 ? 0.f : range[2 * b + 1]);
+            }
+    if (minDensity > maxDensity) minDensity = 0.f;
+}
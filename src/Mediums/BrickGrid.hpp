@@ -0,0 +1,64 @@
+#ifndef BRICKGRID_HPP
+#define BRICKGRID_HPP
+
+#include <memory>
+#include <string>
+#include <cstdint>
+#include "DensityGrid.hpp"
+#include "MappedFile.hpp"
+
+class VoxelGrid;
+
+// 稀疏brick体素网格（类似VDB的叶节点）：体素按brickSize^3分块，顶层索引记录每块在数据区中的编号，全0的块不存储
+// 每块另存最小/最大密度，直接作为GridMedium的majorant（每块一格）；块内密度为常数时GridMedium可以解析地处理
+// 文件（.bvol）按以下布局存放，加载时整个内存映射，不复制也不解压，大体积只有被光线访问到的块才会读入内存：
+//   BrickHeader | int32 index[bricks] (-1为空块) | float range[brickCount][2] (min, max) | float data[brickCount][brickSize^3]
+class BrickGrid : public DensityGrid{
+public:
+    struct BrickHeader{
+        char magic[8]; // "MPTBRICK"
+        uint32_t version;
+        uint32_t brickSize; // 2的幂
+        int32_t resolution[3]; // 体素分辨率
+        int32_t bricks[3]; // 每轴的块数，ceil(resolution / brickSize)
+        uint32_t brickCount; // 有数据的块数
+        uint32_t reserved;
+        float bounds[6]; // xmin, ymin, zmin, xmax, ymax, zmax
+        uint64_t indexOffset, rangeOffset, dataOffset;
+    };
+    static const uint32_t VERSION = 1;
+
+    // 映射并校验文件，失败时返回空
+    static std::unique_ptr<BrickGrid> load(const std::string &filename);
+    // 把稠密网格按块写成.bvol文件，密度全为0的块不存储
+    static bool write(const std::string &filename, const VoxelGrid &grid, int brickSize = 8);
+
+    float density(const Vector3f &p) const override;
+    void densityRange(const Vector3f &lo, const Vector3f &hi, float &minDensity, float &maxDensity) const override;
+    int majorantResolution(int axis) const override {return bricks[axis];}
+    // 只混入块索引和每块的密度范围，不读取全部体素数据（否则整个文件都要从磁盘读入）
+    uint64_t hash(uint64_t h) const override;
+
+    uint32_t getBrickCount() const {return brickCount;}
+
+private:
+    BrickGrid(std::unique_ptr<MappedFile> file, const BrickHeader &header);
+
+    std::unique_ptr<MappedFile> file;
+    int bricks[3];
+    int shift; // log2(brickSize)
+    uint32_t brickCount;
+    const int32_t *index;
+    const float *range;
+    const float *data;
+
+    float voxel(int x, int y, int z) const
+    {
+        int b = index[((z >> shift) * bricks[1] + (y >> shift)) * bricks[0] + (x >> shift)];
+        if (b < 0) return 0.f;
+        int mask = (1 << shift) - 1;
+        return data[((size_t)b << (3 * shift)) + ((((z & mask) << shift) + (y & mask)) << shift) + (x & mask)];
+    }
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef DENSITYGRID_HPP
+#define DENSITYGRID_HPP
+
+#include <cmath>
+#include <algorithm>
+#include "Bounds3.hpp"
+#include "global.hpp"
+
+// 体素密度场的接口：nx * ny * nz个密度值均匀覆盖包围盒bounds，值位于体素中心，按三线性插值取值，包围盒外为0
+// 稠密网格见VoxelGrid，稀疏brick网格见BrickGrid
+class DensityGrid{
+public:
+    DensityGrid(const Bounds3 &bounds, int nx, int ny, int nz) : bounds(bounds), n{nx, ny, nz} {}
+    virtual ~DensityGrid() = default;
+
+    const Bounds3& getBounds() const {return bounds;}
+    int resolution(int axis) const {return n[axis];}
+
+    // 三线性插值的密度
+    virtual float density(const Vector3f &p) const = 0;
+    // 世界空间盒[lo, hi]内任意点插值时用到的体素的最小/最大密度
+    virtual void densityRange(const Vector3f &lo, const Vector3f &hi, float &minDensity, float &maxDensity) const = 0;
+    // GridMedium的majorant网格在该轴上的格数
+    virtual int majorantResolution(int axis) const = 0;
+    // 把包围盒、分辨率和密度混入哈希h，用于校验断点与场景是否一致
+    virtual uint64_t hash(uint64_t h) const
+    {
+        h = hash_bytes(&bounds, sizeof(bounds), h);
+        return hash_bytes(n, sizeof(n), h);
+    }
+
+protected:
+    Bounds3 bounds;
+    int n[3];
+
+    // 三线性插值，fetch(x, y, z)返回体素值，边界外一层按最近体素取值
+    template<typename Fetch>
+    float interpolate(const Vector3f &p, const Fetch &fetch) const
+    {
+        if (p.x < bounds.pMin.x || p.y < bounds.pMin.y || p.z < bounds.pMin.z ||
+            p.x > bounds.pMax.x || p.y > bounds.pMax.y || p.z > bounds.pMax.z) return 0.f;
+        Vector3f d = bounds.Diagonal();
+        float gx = (p.x - bounds.pMin.x) / d.x * n[0] - 0.5f;
+        float gy = (p.y - bounds.pMin.y) / d.y * n[1] - 0.5f;
+        float gz = (p.z - bounds.pMin.z) / d.z * n[2] - 0.5f;
+        int ix = (int)std::floor(gx), iy = (int)std::floor(gy), iz = (int)std::floor(gz);
+        float fx = gx - ix, fy = gy - iy, fz = gz - iz;
+        int x0 = std::max(ix, 0), x1 = std::min(ix + 1, n[0] - 1);
+        int y0 = std::max(iy, 0), y1 = std::min(iy + 1, n[1] - 1);
+        int z0 = std::max(iz, 0), z1 = std::min(iz + 1, n[2] - 1);
+        float c00 = fetch(x0, y0, z0) * (1 - fx) + fetch(x1, y0, z0) * fx;
+        float c10 = fetch(x0, y1, z0) * (1 - fx) + fetch(x1, y1, z0) * fx;
+        float c01 = fetch(x0, y0, z1) * (1 - fx) + fetch(x1, y0, z1) * fx;
+        float c11 = fetch(x0, y1, z1) * (1 - fx) + fetch(x1, y1, z1) * fx;
+        float c0 = c00 * (1 - fy) + c10 * fy, c1 = c01 * (1 - fy) + c11 * fy;
+        return c0 * (1 - fz) + c1 * fz;
+    }
+
+    // [lo, hi]内的点插值时用到的体素下标范围[i0, i1]（floor(g)和floor(g) + 1）
+    void voxelRange(const Vector3f &lo, const Vector3f &hi, int i0[3], int i1[3]) const
+    {
+        Vector3f d = bounds.Diagonal();
+        float l[3] = {lo.x, lo.y, lo.z}, h[3] = {hi.x, hi.y, hi.z};
+        float pMin[3] = {bounds.pMin.x, bounds.pMin.y, bounds.pMin.z}, extent[3] = {d.x, d.y, d.z};
+        for (int axis = 0; axis < 3; ++axis) {
+            i0[axis] = std::max(0, (int)std::floor((l[axis] - pMin[axis]) / extent[axis] * n[axis] - 0.5f));
+            i1[axis] = std::min(n[axis] - 1, (int)std::floor((h[axis] - pMin[axis]) / extent[axis] * n[axis] - 0.5f) + 1);
+        }
+    }
+};
+
+#endif
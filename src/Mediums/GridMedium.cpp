@@ -0,0 +1,133 @@
+#include <cmath>
+#include <algorithm>
+#include "GridMedium.hpp"
+
+GridMedium::GridMedium(std::unique_ptr<DensityGrid> voxels, const float &sigma_a, const float &sigma_s, PhaseFunction *pf)
+    : Medium(INHOMOMEDIUM, pf), grid(std::move(voxels)), sigma_t(sigma_a + sigma_s), albedo(sigma_s / (sigma_a + sigma_s))
+{
+    const Bounds3 &bounds = grid->getBounds();
+    Vector3f d = bounds.Diagonal();
+    float extent[3] = {d.x, d.y, d.z};
+    for (int axis = 0; axis < 3; ++axis) {
+        res[axis] = std::max(1, grid->majorantResolution(axis));
+        cellSize[axis] = extent[axis] / res[axis];
+    }
+    minorant.resize(res[0] * res[1] * res[2]);
+    majorant.resize(res[0] * res[1] * res[2]);
+    for (int z = 0; z < res[2]; ++z) for (int y = 0; y < res[1]; ++y) for (int x = 0; x < res[0]; ++x) {
+        Vector3f lo = bounds.pMin + Vector3f(x * cellSize[0], y * cellSize[1], z * cellSize[2]);
+        Vector3f hi = lo + Vector3f(cellSize[0], cellSize[1], cellSize[2]);
+        float minDensity, maxDensity;
+        grid->densityRange(lo, hi, minDensity, maxDensity);
+        minorant[(z * res[1] + y) * res[0] + x] = sigma_t * minDensity;
+        majorant[(z * res[1] + y) * res[0] + x] = sigma_t * maxDensity;
+    }
+}
+
+uint64_t GridMedium::hash(uint64_t h) const
+{
+    h = hash_bytes(&sigma_t, sizeof(sigma_t), h);
+    h = hash_bytes(&albedo, sizeof(albedo), h);
+    h = grid->hash(h);
+    return Medium::hash(h);
+}
+
+bool GridMedium::intersect(const Ray &ray, const float &tMax, float &t0, float &t1) const
+{
+    return clipToBox(grid->getBounds(), ray, tMax, t0, t1);
+}
+
+// 先与包围盒求交得到[t0, t1]，再按Amanatides-Woo的3D-DDA逐格前进
+template<typename Segment>
+void GridMedium::traverse(const Ray &ray, float tMax, const Segment &segment) const
+{
+    float t0, t1;
+    if (!intersect(ray, tMax, t0, t1)) return;
+    const Bounds3 &bounds = grid->getBounds();
+    float o[3] = {ray.origin.x, ray.origin.y, ray.origin.z};
+    float dir[3] = {ray.direction.x, ray.direction.y, ray.direction.z};
+    float lo[3] = {bounds.pMin.x, bounds.pMin.y, bounds.pMin.z};
+
+    int cell[3], step[3];
+    float tNext[3], tDelta[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        float p = o[axis] + dir[axis] * t0;
+        cell[axis] = clamp(0, res[axis] - 1, std::floor((p - lo[axis]) / cellSize[axis]));
+        if (dir[axis] > 0.f) {
+            step[axis] = 1;
+            tNext[axis] = (lo[axis] + (cell[axis] + 1) * cellSize[axis] - o[axis]) / dir[axis];
+            tDelta[axis] = cellSize[axis] / dir[axis];
+        } else if (dir[axis] < 0.f) {
+            step[axis] = -1;
+            tNext[axis] = (lo[axis] + cell[axis] * cellSize[axis] - o[axis]) / dir[axis];
+            tDelta[axis] = -cellSize[axis] / dir[axis];
+        } else {
+            step[axis] = 0;
+            tNext[axis] = kInfinity;
+            tDelta[axis] = 0.f;
+        }
+    }
+
+    float t = t0;
+    while (true) {
+        int axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+        float tEnd = std::min(tNext[axis], t1);
+        int c = (cell[2] * res[1] + cell[1]) * res[0] + cell[0];
+        if (tEnd > t && !segment(t, tEnd, minorant[c], majorant[c])) return;
+        if (tEnd >= t1) return;
+        t = tEnd;
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] >= res[axis]) return;
+        tNext[axis] += tDelta[axis];
+    }
+}
+
+// ratio tracking：每个虚拟碰撞乘上1 - sigma_t(x) / sigma_maj，常数格直接乘exp(-sigma_t * 长度)，透射率很小时俄罗斯轮盘赌提前结束
+float GridMedium::Tr(const Ray &ray, const float &tMax)
+{
+    float T = 1.f;
+    traverse(ray, tMax, [&](float t0, float t1, float sigmaMin, float sigmaMaj) {
+        if (sigmaMaj <= 0.f) return true;
+        if (sigmaMin == sigmaMaj) {
+            T *= std::exp(-sigmaMaj * (t1 - t0));
+            return T > 0.f;
+        }
+        float t = t0;
+        while (true) {
+            t -= std::log(1 - get_random_float()) / sigmaMaj;
+            if (t >= t1) return true;
+            T *= 1.f - sigma_t * grid->density(ray(t)) / sigmaMaj;
+            if (T < 0.1f) {
+                if (get_random_float() >= T * 10.f) {
+                    T = 0.f;
+                    return false;
+                }
+                T = 0.1f;
+            }
+        }
+    });
+    return T;
+}
+
+// delta tracking：以sigma_maj采样碰撞，按sigma_t(x) / sigma_maj的概率为真实碰撞，否则为虚拟碰撞继续前进
+// 真实碰撞的概率密度为sigma_t(x) * Tr，散射时系数为sigma_s(x) * Tr / (sigma_t(x) * Tr) = 反照率；穿过介质的概率为Tr，系数为1
+float GridMedium::sample(const Ray &ray, const float &tMax, float &weight)
+{
+    float tHit = tMax;
+    weight = 1.f;
+    traverse(ray, tMax, [&](float t0, float t1, float sigmaMin, float sigmaMaj) {
+        if (sigmaMaj <= 0.f) return true;
+        float t = t0;
+        while (true) {
+            t -= std::log(1 - get_random_float()) / sigmaMaj;
+            if (t >= t1) return true;
+            // 常数格内每次碰撞都是真实碰撞，不需要查询密度
+            if (sigmaMin == sigmaMaj || get_random_float() * sigmaMaj < sigma_t * grid->density(ray(t))) {
+                tHit = t;
+                weight = albedo;
+                return false;
+            }
+        }
+    });
+    return tHit;
+}
@@ -0,0 +1,38 @@
+#ifndef GRIDMEDIUM_HPP
+#define GRIDMEDIUM_HPP
+
+#include <vector>
+#include <memory>
+#include "Medium.hpp"
+#include "DensityGrid.hpp"
+
+// 非均匀介质：密度来自体素网格（稠密的VoxelGrid或稀疏的BrickGrid），sigma_a/sigma_s为密度1处的吸收/散射系数，反照率处处相同
+// 距离采样用delta tracking，透射率用ratio tracking，refer: Novák et al. 2014, "Residual Ratio Tracking"
+// 二者都沿粗分辨率的majorant网格（每格为格内插值密度的上界，分辨率由密度网格决定）做DDA，每格内以该格的majorant为上界采样虚拟碰撞，
+// majorant为0的格直接跳过，格内密度为常数（上下界相等）时解析地计算，因此每条光线的代价与沿途的密度成正比，而与体素分辨率无关
+class GridMedium : public Medium{
+public:
+    GridMedium(std::unique_ptr<DensityGrid> grid, const float &sigma_a, const float &sigma_s, PhaseFunction *pf);
+    ~GridMedium() = default;
+
+    // 与体素网格包围盒的交
+    bool intersect(const Ray &ray, const float &tMax, float &t0, float &t1) const override;
+    float Tr(const Ray &ray, const float &tMax) override;
+    float sample(const Ray &ray, const float &tMax, float &weight) override;
+
+    const Bounds3& getBounds() const {return grid->getBounds();}
+    uint64_t hash(uint64_t h) const override;
+
+private:
+    std::unique_ptr<DensityGrid> grid;
+    float sigma_t, albedo;
+    int res[3]; // majorant网格分辨率
+    float cellSize[3];
+    std::vector<float> minorant, majorant; // 每格sigma_t的下界和上界
+
+    // 按顺序访问ray上[0, tMax)与网格相交的每一格，segment(t0, t1, sigma_min, sigma_maj)返回false时停止
+    template<typename Segment>
+    void traverse(const Ray &ray, float tMax, const Segment &segment) const;
+};
+
+#endif
@@ -9,9 +9,15 @@ public:
     HomoMedium(const float &sigma_a, const float &sigma_s, PhaseFunction *pf) 
     : Medium(HOMOMEDIUM, pf), sigma_a(sigma_a), sigma_s(sigma_s), sigma_t(sigma_a + sigma_s){}
     ~HomoMedium() = default;
-    inline float Tr(const float &distance) override;
-    inline float sample(const Ray &ray) override;
-    inline float coefficient(const float &distance, const float &max_distance) override;
+    inline float Tr(const float &distance);
+    inline float Tr(const Ray &ray, const float &tMax) override;
+    inline float sample(const Ray &ray, const float &tMax, float &weight) override;
+    inline float pdf(const Ray &ray, const float &t, float &albedo) override;
+    uint64_t hash(uint64_t h) const override {
+        h = hash_bytes(&sigma_a, sizeof(sigma_a), h);
+        h = hash_bytes(&sigma_s, sizeof(sigma_s), h);
+        return Medium::hash(h);
+    }
 
 private:
     float sigma_a, sigma_s, sigma_t;
@@ -21,17 +27,21 @@ inline float HomoMedium::Tr(const float &distance){
     return std::exp(-sigma_t * distance);
 }
 
-inline float HomoMedium::sample(const Ray &ray){
+inline float HomoMedium::Tr(const Ray &ray, const float &tMax){
+    return Tr(tMax);
+}
+
+// 按sigma_t * Tr(t)采样距离，超过tMax的概率为Tr(tMax)
+// 散射时系数为sigma_s * Tr / (sigma_t * Tr)，到达表面时为Tr / Tr = 1
+inline float HomoMedium::sample(const Ray &ray, const float &tMax, float &weight){
     float t = -std::log(1 - get_random_float()) / sigma_t;
+    weight = t < tMax ? sigma_s / sigma_t : 1.f;
     return t;
 }
 
-inline float HomoMedium::coefficient(const float &distance, const float &max_distance){
-    float pdf_medium = sigma_t * Tr(distance);
-    float pdf_surface = std::exp(-sigma_t * max_distance);
-    float coeff_medium = sigma_s * Tr(distance) / pdf_medium;
-    float coeff_surf = Tr(max_distance) / pdf_surface;
-    return distance < max_distance ? coeff_medium : coeff_surf;
+inline float HomoMedium::pdf(const Ray &ray, const float &t, float &albedo){
+    albedo = sigma_s / sigma_t;
+    return sigma_t * Tr(t);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,9 +1,11 @@
 #ifndef MEDIUM_HPP
 #define MEDIUM_HPP
 
+#include <algorithm>
 #include "Vector.hpp"
 #include "PhaseFunction.hpp"
 #include "Ray.hpp"
+#include "Bounds3.hpp"
 
 enum MediumType{HOMOMEDIUM, INHOMOMEDIUM};
 
@@ -12,22 +14,58 @@ protected:
     MediumType type;
 public:
     Medium(MediumType type, PhaseFunction *pf) : type(type), pf(pf) {}
-    ~Medium() = default;
+    virtual ~Medium() = default;
 
     PhaseFunction* pf;
 
     inline MediumType getType() {return type;}
+    // ray上[0, tMax)段与介质所在范围的交[t0, t1]（可以是保守的），不相交时返回false；默认介质充满整个场景
+    inline virtual bool intersect(const Ray &ray, const float &tMax, float &t0, float &t1) const {
+        t0 = 0.f;
+        t1 = tMax;
+        return tMax > 0.f;
+    }
+
     // ray should be unoccluded and fully contained in the medium
-    //virtual inline Vector3f Tr(const Ray &ray) = 0;
-    // 返回透射率
-    inline virtual float Tr(const float &distance) = 0;
+    // 返回ray上[0, tMax)段的透射率
+    inline virtual float Tr(const Ray &ray, const float &tMax) = 0;
+
+    // 沿ray在[0, tMax)内采样散射距离，返回值小于tMax表示在介质中发生散射，否则光线穿过介质到达tMax处的表面
+    // weight返回radiance的系数（包括要除的距离采样的pdf）
+    inline virtual float sample(const Ray &ray, const float &tMax, float &weight) = 0;
 
-    //沿ray采样距离
-    inline virtual float sample(const Ray &ray) = 0;
+    // sample在t处发生真实碰撞的概率密度sigma_t(t) * Tr(0, t)，albedo返回该处的反照率sigma_s / sigma_t
+    // 不能解析计算时（如非均匀介质）返回负数
+    inline virtual float pdf(const Ray &ray, const float &t, float &albedo) {return -1.f;}
 
-    //返回radiance的系数（包括要除的距离采样的pdf）
-    //virtual inline float pdf(const Ray &ray) = 0;
-    inline virtual float coefficient(const float &distance, const float &max_distance) = 0;
+    // 把介质的类型、系数、范围和相函数混入哈希h，用于校验断点与场景是否一致；子类混入自己的参数后调用基类
+    virtual uint64_t hash(uint64_t h) const {
+        h = hash_bytes(&type, sizeof(type), h);
+        return pf ? pf->hash(h) : h;
+    }
+
+protected:
+    // ray上[0, tMax)与包围盒box的交[t0, t1]（slab测试），不相交时返回false
+    static inline bool clipToBox(const Bounds3 &box, const Ray &ray, const float &tMax, float &t0, float &t1) {
+        float o[3] = {ray.origin.x, ray.origin.y, ray.origin.z};
+        float dir[3] = {ray.direction.x, ray.direction.y, ray.direction.z};
+        float lo[3] = {box.pMin.x, box.pMin.y, box.pMin.z};
+        float hi[3] = {box.pMax.x, box.pMax.y, box.pMax.z};
+        t0 = 0.f;
+        t1 = tMax;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (dir[axis] == 0.f) {
+                if (o[axis] < lo[axis] || o[axis] > hi[axis]) return false;
+                continue;
+            }
+            float tNear = (lo[axis] - o[axis]) / dir[axis], tFar = (hi[axis] - o[axis]) / dir[axis];
+            if (tNear > tFar) std::swap(tNear, tFar);
+            t0 = std::max(t0, tNear);
+            t1 = std::min(t1, tFar);
+            if (t0 >= t1) return false;
+        }
+        return true;
+    }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -19,14 +19,22 @@ public:
     // 计算phase function
     // wi入射，wo入射，方向均朝外
     inline virtual float eval(const Vector3f &wi, const Vector3f &wo) = 0;
+
+    virtual ~PhaseFunction() = default;
+    // 把相函数的参数混入哈希h，用于校验断点与场景是否一致
+    virtual uint64_t hash(uint64_t h) const = 0;
 };
 
 class HenyeyGreensteinMedium : public PhaseFunction{
 public:
-    HenyeyGreensteinMedium(float g) : g(g){}
+    HenyeyGreensteinMedium(float g) : g(clamp(-1.f, 1.f, g)){}
     inline Vector3f sample(const Vector3f &wo, const Vector3f &position) override;
     inline float pdf(const Vector3f &wi, const Vector3f &wo) override;
     inline float eval(const Vector3f &wi, const Vector3f &wo) override;
+    uint64_t hash(uint64_t h) const override {
+        h = hash_bytes("HG", 2, h);
+        return hash_bytes(&g, sizeof(g), h);
+    }
 private:
     float g;
 };
@@ -54,8 +62,6 @@ inline float HenyeyGreensteinMedium::pdf(const Vector3f &wi, const Vector3f &wo)
 }
 
 inline float HenyeyGreensteinMedium::eval(const Vector3f &wi, const Vector3f &wo){
-    g = clamp(-1.f, 1.f, g);
-
     float costheta = dotProduct(wi, wo);
     float denom = 1 + g * g + 2 * g * costheta;
     float inv4pi = 1 / (4 * M_PI);
@@ -0,0 +1,113 @@
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include "TabulatedPhaseFunction.hpp"
+
+TabulatedPhaseFunction::TabulatedPhaseFunction(std::vector<float> table)
+    : values(std::move(table))
+{
+    if (values.size() < 2) values.assign(2, 1.f);
+    int n = values.size(), segments = n - 1;
+    float spacing = 2.f / segments;
+    invSpacing = 1.f / spacing;
+    for (auto &v : values) v = std::max(0.f, v);
+
+    // 按梯形累加每个区间的概率（线性插值下是精确的），球面上积分还要乘2pi
+    std::vector<double> mass(n, 0.0);
+    for (int i = 0; i < segments; ++i)
+        mass[i + 1] = mass[i] + 0.5 * spacing * ((double)values[i] + values[i + 1]);
+    if (mass[segments] <= 0.0) {
+        std::fill(values.begin(), values.end(), 1.f);
+        for (int i = 0; i < segments; ++i) mass[i + 1] = (double)(i + 1) * spacing;
+    }
+    double total = mass[segments];
+    float norm = (float)(1.0 / (2.0 * M_PI * total));
+    cdf.resize(n);
+    for (int i = 0; i < n; ++i) {
+        values[i] *= norm;
+        cdf[i] = (float)(mass[i] / total);
+    }
+    cdf[segments] = 1.f;
+
+    guide.resize(segments);
+    for (int k = 0, i = 0; k < segments; ++k) {
+        float u = (float)k / segments;
+        while (i < segments - 1 && cdf[i + 1] <= u) ++i;
+        guide[k] = i;
+    }
+}
+
+std::unique_ptr<TabulatedPhaseFunction> TabulatedPhaseFunction::tabulate(const std::function<float(float)> &p, int resolution)
+{
+    resolution = std::max(2, resolution);
+    std::vector<float> table(resolution);
+    for (int i = 0; i < resolution; ++i) table[i] = p(-1.f + 2.f * i / (resolution - 1));
+    return std::make_unique<TabulatedPhaseFunction>(std::move(table));
+}
+
+std::unique_ptr<TabulatedPhaseFunction> TabulatedPhaseFunction::cornetteShanks(float g, int resolution)
+{
+    g = clamp(-0.999f, 0.999f, g);
+    return tabulate([g](float mu){
+        float denom = 1 + g * g - 2 * g * mu;
+        return 3.f / (8 * M_PI) * (1 - g * g) * (1 + mu * mu) / ((2 + g * g) * denom * std::sqrt(denom));
+    }, resolution);
+}
+
+std::unique_ptr<TabulatedPhaseFunction> TabulatedPhaseFunction::load(const std::string &filename, int resolution)
+{
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Cannot open " << filename << "\n";
+        return nullptr;
+    }
+    std::vector<float> angles, data;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ss(line);
+        float angle, value;
+        if (!(ss >> angle >> value) || (!angles.empty() && angle <= angles.back())) {
+            std::cerr << "Invalid phase function file " << filename << "\n";
+            return nullptr;
+        }
+        angles.push_back(angle);
+        data.push_back(value);
+    }
+    if (angles.empty()) {
+        std::cerr << "Invalid phase function file " << filename << "\n";
+        return nullptr;
+    }
+    // 数据在散射角上插值，mu由大到小时散射角递增
+    return tabulate([&](float mu){
+        float angle = std::acos(clamp(-1.f, 1.f, mu)) * 180.f / M_PI;
+        size_t i = std::upper_bound(angles.begin(), angles.end(), angle) - angles.begin();
+        if (i == 0) return data.front();
+        if (i == angles.size()) return data.back();
+        float t = (angle - angles[i - 1]) / (angles[i] - angles[i - 1]);
+        return data[i - 1] + t * (data[i] - data[i - 1]);
+    }, resolution);
+}
+
+Vector3f TabulatedPhaseFunction::sample(const Vector3f &wo, const Vector3f &position)
+{
+    float u = get_random_float(), phi = 2 * M_PI * get_random_float();
+    int segments = values.size() - 1;
+    int i = guide[std::min((int)(u * segments), segments - 1)];
+    while (i < segments - 1 && cdf[i + 1] <= u) ++i;
+
+    // 区间内pdf从a线性变化到b，解a * x + (b - a) * x^2 / 2 = xi * (a + b) / 2，写成不会相消的形式
+    float a = values[i], b = values[i + 1];
+    float mass = cdf[i + 1] - cdf[i];
+    float xi = mass > 0.f ? clamp(0.f, 1.f, (u - cdf[i]) / mass) : 0.5f;
+    float denom = a + std::sqrt(std::max(0.f, a * a + xi * (b * b - a * a)));
+    float x = denom > 0.f ? xi * (a + b) / denom : xi;
+    float costheta = clamp(-1.f, 1.f, -1.f + (i + x) / invSpacing);
+
+    float sintheta = std::sqrt(std::max(0.f, 1 - costheta * costheta));
+    Vector3f s, t;
+    CoordinateSystem(wo, s, t);
+    return sintheta * std::cos(phi) * s + sintheta * std::sin(phi) * t + costheta * (-wo);
+}
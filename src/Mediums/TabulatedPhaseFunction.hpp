@@ -0,0 +1,54 @@
+#ifndef TABULATEDPHASEFUNCTION_HPP
+#define TABULATEDPHASEFUNCTION_HPP
+
+#include <memory>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <functional>
+#include "PhaseFunction.hpp"
+
+// 查表的相函数：p(mu)在mu = cos(散射角)∈[-1, 1]上等间距地存储，节点之间线性插值（mu = 1为向前散射）
+// 构造时归一化并预计算各节点处的CDF和一张引导表（把u∈[0, 1)等分，记录每份开始所在的区间），
+// 采样时由引导表找到区间，区间内的线性pdf解析求逆，得到的方向严格服从插值后的pdf；eval/pdf只需一次查表插值
+class TabulatedPhaseFunction : public PhaseFunction{
+public:
+    // values为mu = -1到1等间距的N(>= 2)个值，不要求归一化，负值按0处理；全为0时退化为各向同性
+    TabulatedPhaseFunction(std::vector<float> values);
+
+    // 在resolution个节点上对p(mu)取值
+    static std::unique_ptr<TabulatedPhaseFunction> tabulate(const std::function<float(float)> &p, int resolution = 4096);
+    // Cornette-Shanks相函数：对Mie散射的近似，常用于大气中的云和气溶胶
+    static std::unique_ptr<TabulatedPhaseFunction> cornetteShanks(float g, int resolution = 4096);
+    // 读取测量数据：文本文件每行为"散射角（度） 值"，散射角递增，#开头的行为注释；
+    // 在mu上重采样到resolution个节点（数据范围外取端点的值），失败时返回空
+    static std::unique_ptr<TabulatedPhaseFunction> load(const std::string &filename, int resolution = 4096);
+
+    Vector3f sample(const Vector3f &wo, const Vector3f &position) override;
+    inline float pdf(const Vector3f &wi, const Vector3f &wo) override;
+    inline float eval(const Vector3f &wi, const Vector3f &wo) override;
+    uint64_t hash(uint64_t h) const override {
+        h = hash_bytes("TAB", 3, h);
+        return hash_bytes(values.data(), values.size() * sizeof(float), h);
+    }
+
+private:
+    std::vector<float> values; // 归一化后的p(mu)，整个球面上积分为1
+    std::vector<float> cdf; // cdf[i]为mu <= mu_i的概率，cdf[0] = 0，cdf[N - 1] = 1
+    std::vector<int> guide; // guide[k]为u = k / (N - 1)所在的区间
+    float invSpacing; // 1 / 节点间距
+};
+
+inline float TabulatedPhaseFunction::pdf(const Vector3f &wi, const Vector3f &wo){
+    return eval(wi, wo);
+}
+
+inline float TabulatedPhaseFunction::eval(const Vector3f &wi, const Vector3f &wo){
+    // wi和wo均朝外，散射角的余弦为dot(wi, -wo)
+    float x = (1.f - dotProduct(wi, wo)) * invSpacing;
+    int i = std::min(std::max((int)x, 0), (int)values.size() - 2);
+    float t = clamp(0.f, 1.f, x - i);
+    return values[i] + t * (values[i + 1] - values[i]);
+}
+
+#endif
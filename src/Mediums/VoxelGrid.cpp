@@ -0,0 +1,116 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include "VoxelGrid.hpp"
+
+VoxelGrid::VoxelGrid(const Bounds3 &bounds, int nx, int ny, int nz, std::vector<float> data)
+    : DensityGrid(bounds, nx, ny, nz), data(std::move(data)) {}
+
+std::unique_ptr<VoxelGrid> VoxelGrid::loadVol(const std::string &filename)
+{
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if (!fp) {
+        std::cerr << "Cannot open " << filename << "\n";
+        return nullptr;
+    }
+    // 头：'V' 'O' 'L' 版本号3，编码（1 = float32），x/y/z分辨率，通道数，包围盒（xmin, ymin, zmin, xmax, ymax, zmax）
+    char magic[4];
+    int32_t header[5];
+    float box[6];
+    bool ok = fread(magic, 1, 4, fp) == 4 && std::memcmp(magic, "VOL", 3) == 0 && magic[3] == 3
+           && fread(header, sizeof(int32_t), 5, fp) == 5 && header[0] == 1
+           && header[1] > 0 && header[2] > 0 && header[3] > 0 && header[4] > 0
+           && fread(box, sizeof(float), 6, fp) == 6;
+    std::unique_ptr<VoxelGrid> grid;
+    if (ok) {
+        int nx = header[1], ny = header[2], nz = header[3], channels = header[4];
+        size_t n = (size_t)nx * ny * nz;
+        std::vector<float> raw(n * channels);
+        ok = fread(raw.data(), sizeof(float), raw.size(), fp) == raw.size();
+        if (ok) {
+            std::vector<float> density(n);
+            for (size_t i = 0; i < n; ++i) density[i] = std::max(0.f, raw[i * channels]);
+            grid = std::make_unique<VoxelGrid>(Bounds3(Vector3f(box[0], box[1], box[2]), Vector3f(box[3], box[4], box[5])),
+                                               nx, ny, nz, std::move(density));
+        }
+    }
+    fclose(fp);
+    if (!ok) std::cerr << "Invalid volume file " << filename << "\n";
+    return grid;
+}
+
+// 整数格点上的哈希值，[0, 1)
+static float latticeValue(int x, int y, int z, uint32_t seed)
+{
+    uint32_t h = seed * 0x9e3779b9u ^ (uint32_t)x * 0x85ebca6bu ^ (uint32_t)y * 0xc2b2ae35u ^ (uint32_t)z * 0x27d4eb2fu;
+    h ^= h >> 15; h *= 0x2c1b3c6du;
+    h ^= h >> 12; h *= 0x297a2d39u;
+    h ^= h >> 15;
+    return (h >> 8) * (1.f / 16777216.f);
+}
+
+// 格点值三线性插值（smoothstep权重）的值噪声
+static float valueNoise(float x, float y, float z, uint32_t seed)
+{
+    int ix = (int)std::floor(x), iy = (int)std::floor(y), iz = (int)std::floor(z);
+    float fx = x - ix, fy = y - iy, fz = z - iz;
+    fx = fx * fx * (3 - 2 * fx); fy = fy * fy * (3 - 2 * fy); fz = fz * fz * (3 - 2 * fz);
+    float v = 0.f;
+    for (int k = 0; k < 8; ++k) {
+        int dx = k & 1, dy = (k >> 1) & 1, dz = k >> 2;
+        float w = (dx ? fx : 1 - fx) * (dy ? fy : 1 - fy) * (dz ? fz : 1 - fz);
+        v += w * latticeValue(ix + dx, iy + dy, iz + dz, seed);
+    }
+    return v;
+}
+
+std::unique_ptr<VoxelGrid> VoxelGrid::smoke(const Bounds3 &bounds, int resolution, uint32_t seed)
+{
+    Vector3f d = bounds.Diagonal();
+    float maxExtent = std::max(d.x, std::max(d.y, d.z));
+    int n[3] = {std::max(1, (int)std::lround(resolution * d.x / maxExtent)),
+                std::max(1, (int)std::lround(resolution * d.y / maxExtent)),
+                std::max(1, (int)std::lround(resolution * d.z / maxExtent))};
+    std::vector<float> data((size_t)n[0] * n[1] * n[2]);
+    for (int z = 0; z < n[2]; ++z) for (int y = 0; y < n[1]; ++y) for (int x = 0; x < n[0]; ++x) {
+        // 归一化坐标，y向上
+        float u = (x + 0.5f) / n[0], v = (y + 0.5f) / n[1], w = (z + 0.5f) / n[2];
+        // 4层fBm，结果约在[0, 1]内
+        float fbm = 0.f, amplitude = 0.5f, frequency = 4.f;
+        for (int octave = 0; octave < 4; ++octave) {
+            fbm += amplitude * valueNoise(u * frequency, v * frequency * 0.5f, w * frequency, seed + octave);
+            amplitude *= 0.5f;
+            frequency *= 2.f;
+        }
+        fbm /= 0.9375f;
+        // 烟柱的中心随高度摆动，半径随高度变大
+        float cx = 0.5f + 0.12f * std::sin(v * 7.f), cz = 0.5f + 0.12f * std::cos(v * 5.f);
+        float r = std::sqrt((u - cx) * (u - cx) + (w - cz) * (w - cz));
+        float radius = 0.12f + 0.3f * v;
+        float shape = std::max(0.f, 1.f - r / radius) * std::min(1.f, (1.f - v) * 5.f);
+        float density = shape * std::max(0.f, fbm * 2.f - 0.6f) * 2.f;
+        data[((size_t)z * n[1] + y) * n[0] + x] = clamp(0.f, 1.f, density);
+    }
+    return std::make_unique<VoxelGrid>(bounds, n[0], n[1], n[2], std::move(data));
+}
+
+float VoxelGrid::density(const Vector3f &p) const
+{
+    return interpolate(p, [this](int x, int y, int z) {return voxel(x, y, z);});
+}
+
+void VoxelGrid::densityRange(const Vector3f &lo, const Vector3f &hi, float &minDensity, float &maxDensity) const
+{
+    int i0[3], i1[3];
+    voxelRange(lo, hi, i0, i1);
+    minDensity = kInfinity;
+    maxDensity = 0.f;
+    for (int z = i0[2]; z <= i1[2]; ++z) for (int y = i0[1]; y <= i1[1]; ++y) for (int x = i0[0]; x <= i1[0]; ++x) {
+        float v = voxel(x, y, z);
+        minDensity = std::min(minDensity, v);
+        maxDensity = std::max(maxDensity, v);
+    }
+    if (minDensity > maxDensity) minDensity = 0.f;
+}
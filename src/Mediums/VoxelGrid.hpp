@@ -0,0 +1,35 @@
+#ifndef VOXELGRID_HPP
+#define VOXELGRID_HPP
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include "DensityGrid.hpp"
+
+// 稠密体素网格，下标x变化最快
+class VoxelGrid : public DensityGrid{
+public:
+    VoxelGrid(const Bounds3 &bounds, int nx, int ny, int nz, std::vector<float> data);
+
+    // 读取Mitsuba的.vol格式（float32编码，多通道时取第一个通道），失败时返回空
+    static std::unique_ptr<VoxelGrid> loadVol(const std::string &filename);
+    // 程序化生成的烟雾：值噪声fBm调制的上升烟柱，密度在[0, 1]内
+    static std::unique_ptr<VoxelGrid> smoke(const Bounds3 &bounds, int resolution, uint32_t seed = 1);
+
+    float voxel(int x, int y, int z) const {return data[((size_t)z * n[1] + y) * n[0] + x];}
+
+    float density(const Vector3f &p) const override;
+    void densityRange(const Vector3f &lo, const Vector3f &hi, float &minDensity, float &maxDensity) const override;
+    // 每轴最多16格
+    int majorantResolution(int axis) const override {return std::min(16, n[axis]);}
+    uint64_t hash(uint64_t h) const override
+    {
+        return hash_bytes(data.data(), data.size() * sizeof(float), DensityGrid::hash(h));
+    }
+
+private:
+    std::vector<float> data;
+};
+
+#endif
@@ -0,0 +1,203 @@
+#include <cmath>
+#include <algorithm>
+#include "PathGuiding.hpp"
+#include "global.hpp"
+
+// 等面积映射：x = (cosTheta + 1) / 2，y = phi / 2pi，正方形上的密度除以4pi即立体角pdf
+static Vector2f dirToCanonical(const Vector3f &w)
+{
+    float cosTheta = std::min(1.f, std::max(-1.f, w.z));
+    float phi = std::atan2(w.y, w.x);
+    if (phi < 0.f) phi += 2 * M_PI;
+    return Vector2f((cosTheta + 1) * 0.5f, std::min<float>(phi / (2 * M_PI), 1.f));
+}
+
+static Vector3f canonicalToDir(const Vector2f &p)
+{
+    float cosTheta = 2 * p.x - 1, phi = 2 * M_PI * p.y;
+    float sinTheta = std::sqrt(std::max(0.f, 1 - cosTheta * cosTheta));
+    return Vector3f(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+static void atomicAdd(std::atomic<float> &a, float v)
+{
+    float old = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(old, old + v, std::memory_order_relaxed)) {}
+}
+
+QuadNode::QuadNode()
+{
+    for (int i = 0; i < 4; ++i) {
+        sum[i] = 0.f;
+        child[i] = 0;
+    }
+}
+
+QuadNode::QuadNode(const QuadNode &other) { *this = other; }
+
+QuadNode& QuadNode::operator=(const QuadNode &other)
+{
+    for (int i = 0; i < 4; ++i) {
+        sum[i] = other.sum[i].load(std::memory_order_relaxed);
+        child[i] = other.child[i];
+    }
+    return *this;
+}
+
+int QuadNode::childIndex(Vector2f &p)
+{
+    int q = 0;
+    if (p.x >= 0.5f) { q |= 1; p.x = p.x * 2 - 1; } else p.x *= 2;
+    if (p.y >= 0.5f) { q |= 2; p.y = p.y * 2 - 1; } else p.y *= 2;
+    return q;
+}
+
+DTree::DTree() : nodes(1), count(0) {}
+
+DTree::DTree(const DTree &other) : nodes(other.nodes), count(other.count.load()) {}
+
+DTree& DTree::operator=(const DTree &other)
+{
+    nodes = other.nodes;
+    count = other.count.load();
+    return *this;
+}
+
+void DTree::record(const Vector3f &w, float value)
+{
+    count.fetch_add(1, std::memory_order_relaxed);
+    if (!(value > 0.f) || !std::isfinite(value)) return;
+    Vector2f p = dirToCanonical(w);
+    uint32_t n = 0;
+    while (true) {
+        int q = QuadNode::childIndex(p);
+        atomicAdd(nodes[n].sum[q], value);
+        if (!nodes[n].child[q]) break;
+        n = nodes[n].child[q];
+    }
+}
+
+float DTree::pdf(const Vector3f &w) const
+{
+    Vector2f p = dirToCanonical(w);
+    float density = 1.f;
+    uint32_t n = 0;
+    while (true) {
+        const QuadNode &node = nodes[n];
+        float t = node.total();
+        if (t <= 0.f) return 0.f;
+        int q = QuadNode::childIndex(p);
+        density *= 4 * node.sum[q] / t;
+        if (!node.child[q]) break;
+        n = node.child[q];
+    }
+    return density / (4 * M_PI);
+}
+
+Vector3f DTree::sample() const
+{
+    Vector2f origin(0.f);
+    float size = 1.f;
+    uint32_t n = 0;
+    while (true) {
+        const QuadNode &node = nodes[n];
+        // 按能量选择象限，跳过能量为0的象限
+        float u = get_random_float() * node.total(), acc = node.sum[0];
+        int q = 0;
+        while (q < 3 && u >= acc) acc += node.sum[++q];
+        while (q > 0 && node.sum[q] == 0.f) --q;
+        size *= 0.5f;
+        origin = origin + Vector2f((q & 1) * size, (q >> 1) * size);
+        if (!node.child[q]) break;
+        n = node.child[q];
+    }
+    return canonicalToDir(origin + size * Vector2f(get_random_float(), get_random_float()));
+}
+
+void DTree::refine(const DTree &previous, float threshold, int maxDepth)
+{
+    nodes.assign(1, QuadNode());
+    count = 0;
+    float total = previous.total();
+    // 新节点，previous中对应的节点（没有时为-1，子象限按父象限能量的1/4估计），节点的能量占比，深度
+    struct Entry { uint32_t node; int previousNode; float fraction; int depth; };
+    std::vector<Entry> stack = {{0, 0, 1.f, 1}};
+    while (!stack.empty()) {
+        Entry e = stack.back();
+        stack.pop_back();
+        if (e.depth >= maxDepth) continue;
+        for (int q = 0; q < 4; ++q) {
+            float fraction = e.previousNode >= 0 ? (total > 0.f ? previous.nodes[e.previousNode].sum[q] / total : 0.f)
+                                                 : e.fraction / 4;
+            if (fraction <= threshold) continue;
+            uint32_t child = nodes.size();
+            nodes.emplace_back();
+            nodes[e.node].child[q] = child;
+            int previousChild = e.previousNode >= 0 && previous.nodes[e.previousNode].child[q] ?
+                                (int)previous.nodes[e.previousNode].child[q] : -1;
+            stack.push_back({child, previousChild, fraction, e.depth + 1});
+        }
+    }
+}
+
+GuidingField::GuidingField(const Bounds3 &bounds) : nodes(1), leaves(1)
+{
+    Vector3f d = bounds.Diagonal();
+    size = std::max(std::max(d.x, d.y), d.z) * 1.001f;
+    origin = bounds.pMin;
+}
+
+int GuidingField::lookup(const Vector3f &p) const
+{
+    float q[3] = {(p.x - origin.x) / size, (p.y - origin.y) / size, (p.z - origin.z) / size};
+    uint32_t n = 0;
+    while (nodes[n].child[0]) {
+        float &v = q[nodes[n].axis];
+        if (v < 0.5f) {
+            v *= 2;
+            n = nodes[n].child[0];
+        } else {
+            v = v * 2 - 1;
+            n = nodes[n].child[1];
+        }
+    }
+    return nodes[n].leaf;
+}
+
+void GuidingField::update()
+{
+    // 空间细分：子节点复制父节点的两棵方向树，各继承一半的样本数，直到样本数不超过阈值
+    float threshold = spatialThreshold * std::sqrt(std::pow(2.f, (float)iteration));
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+        uint32_t n = stack.back();
+        stack.pop_back();
+        if (nodes[n].child[0]) {
+            stack.push_back(nodes[n].child[0]);
+            stack.push_back(nodes[n].child[1]);
+            continue;
+        }
+        int leaf = nodes[n].leaf;
+        if (leaves[leaf].building.sampleCount() <= threshold) continue;
+        leaves[leaf].building.halveCount();
+        Leaf copy = leaves[leaf];
+        leaves.push_back(copy);
+
+        SpatialNode c0, c1;
+        c0.axis = c1.axis = (nodes[n].axis + 1) % 3;
+        c0.leaf = leaf;
+        c1.leaf = leaves.size() - 1;
+        nodes[n].child[0] = nodes.size();
+        nodes[n].child[1] = nodes.size() + 1;
+        nodes.push_back(c0);
+        nodes.push_back(c1);
+        stack.push_back(nodes[n].child[0]);
+        stack.push_back(nodes[n].child[1]);
+    }
+
+    for (auto &leaf : leaves) {
+        leaf.sampling = leaf.building;
+        leaf.building.refine(leaf.sampling, directionalThreshold, maxDirectionalDepth);
+    }
+    ++iteration;
+}
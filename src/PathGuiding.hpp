@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include "Vector.hpp"
+#include "Bounds3.hpp"
+
+// 方向四叉树：把单位球按等面积映射(cosTheta, phi) -> [0, 1]^2，在正方形上做自适应四分
+// 每个节点存4个子象限的能量和，叶子象限的能量均匀分布在象限内，得到分段常数的方向分布
+// 训练时多线程对能量做原子加（CAS循环，不加锁），采样和求pdf时只读
+struct QuadNode
+{
+    std::atomic<float> sum[4];
+    uint32_t child[4]; // 子节点下标，0表示该象限是叶子
+
+    QuadNode();
+    QuadNode(const QuadNode &other);
+    QuadNode& operator=(const QuadNode &other);
+
+    float total() const { return sum[0] + sum[1] + sum[2] + sum[3]; }
+    // p所在的象限，并把p变换到该象限内的[0, 1]^2
+    static int childIndex(Vector2f &p);
+};
+
+class DTree
+{
+public:
+    DTree();
+    DTree(const DTree &other);
+    DTree& operator=(const DTree &other);
+
+    // 记录方向w上的一个估计值（radiance / pdf），线程安全
+    void record(const Vector3f &w, float value);
+    // 方向w的立体角pdf，能量为0时返回0
+    float pdf(const Vector3f &w) const;
+    Vector3f sample() const;
+
+    float total() const { return nodes[0].total(); }
+    uint64_t sampleCount() const { return count; }
+    void halveCount() { count = count / 2; }
+
+    // 以previous的能量分布为依据重建结构：能量占比超过threshold的象限继续四分（不超过maxDepth层），能量清零
+    void refine(const DTree &previous, float threshold, int maxDepth);
+
+private:
+    std::vector<QuadNode> nodes;
+    std::atomic<uint64_t> count; // 记录的样本数，决定空间树是否细分
+};
+
+// 空间-方向树（SD-tree），refer: Müller et al. 2017, Practical Path Guiding for Efficient Light-Transport Simulation
+// 空间上是把场景包围立方体沿x/y/z轴轮流对半分的二叉树，每个叶子对应一对方向四叉树：
+// building在当前的训练周期中累加路径的入射radiance，sampling是上一个周期训练好的分布，用于采样
+// 训练周期的长度逐次翻倍，每个周期结束（两轮之间，单线程）调用update：
+// 样本数超过阈值（随周期数按sqrt(2^k)增长）的空间叶子一分为二，然后building转为sampling，并按能量细分出新的building
+// 训练在渲染中进行，多线程直接原子地累加到building，不需要逐线程的缓冲和合并
+class GuidingField
+{
+public:
+    explicit GuidingField(const Bounds3 &bounds);
+
+    float bsdfSamplingFraction = 0.5f; // one-sample MIS中按brdf采样的概率，其余按引导分布采样
+    float spatialThreshold = 12000.f; // 空间叶子细分的样本数阈值（第一个周期）
+    float directionalThreshold = 0.01f; // 方向四叉树中能量占比超过它的象限继续四分
+    int maxDirectionalDepth = 20;
+
+    // 点p所在的空间叶子
+    int lookup(const Vector3f &p) const;
+    // 叶子是否已经训练过（有可用于采样的分布）
+    bool canSample(int leaf) const { return leaves[leaf].sampling.total() > 0.f; }
+    Vector3f sample(int leaf) const { return leaves[leaf].sampling.sample(); }
+    float pdf(int leaf, const Vector3f &w) const { return leaves[leaf].sampling.pdf(w); }
+    void record(int leaf, const Vector3f &w, float value) { leaves[leaf].building.record(w, value); }
+
+    // 结束一个训练周期，不能与record/sample并行调用
+    void update();
+    int iterations() const { return iteration; }
+
+private:
+    struct SpatialNode
+    {
+        int axis = 0; // 细分时对半分的轴
+        uint32_t child[2] = {0, 0}; // 0表示叶子
+        int leaf = 0; // 叶子对应的leaves下标
+    };
+    struct Leaf
+    {
+        DTree sampling, building;
+    };
+
+    Vector3f origin; // 包围立方体
+    float size;
+    std::vector<SpatialNode> nodes;
+    std::vector<Leaf> leaves;
+    int iteration = 0;
+};
@@ -6,6 +6,7 @@
 #include "OBJ_Loader.hpp"
 #include "Object.hpp"
 #include "Triangle.hpp"
+#include "AliasTable.hpp"
 #include <cassert>
 #include <array>
 
@@ -23,6 +24,10 @@ public:
 
     BVHAccel* bvh;
     float area;
+    AliasTable triangleDistribution; // 按面积选择三角形，用于光源采样
+    // 由两个三角形组成的矩形（如cornell box的顶灯）按球面矩形采样：角点和两条互相垂直的边
+    bool isRectangle = false;
+    Vector3f rectCorner, rectEdge0, rectEdge1;
 
     Material* m;
 
@@ -91,11 +96,46 @@ public:
         bounding_box = Bounds3(min_vert, max_vert); // 构建网格体的包围盒
 
         std::vector<Object*> ptrs;
+        std::vector<float> areas;
         for (auto& tri : triangles){
             ptrs.push_back(&tri);
+            areas.push_back(tri.area);
             area += tri.area;
         }
         bvh = new BVHAccel(ptrs); // 对一个网格体中所有三角形进行划分，构建BVH
+        triangleDistribution.build(areas);
+        findRectangle();
+    }
+
+    // 判断网格体是否是两个三角形组成的矩形：四个不同的顶点中某一个到另外两个的边互相垂直，且两边之和指向第四个顶点
+    void findRectangle()
+    {
+        if (triangles.size() != 2) return;
+        std::vector<Vector3f> points;
+        for (auto &tri : triangles) {
+            for (auto &v : {tri.v0, tri.v1, tri.v2}) {
+                bool found = false;
+                for (auto &q : points) found |= dotProduct(q - v, q - v) <= 1e-8f * area;
+                if (!found) points.push_back(v);
+            }
+        }
+        if (points.size() != 4) return;
+        for (int c = 0; c < 4; ++c) {
+            int others[3], n = 0;
+            for (int i = 0; i < 4; ++i) if (i != c) others[n++] = i;
+            // 依次以其余顶点中的一个作为c的对角顶点d
+            for (int k = 0; k < 3; ++k) {
+                int d = others[k], a = others[(k + 1) % 3], b = others[(k + 2) % 3];
+                Vector3f e0 = points[a] - points[c], e1 = points[b] - points[c];
+                Vector3f diag = points[c] + e0 + e1 - points[d];
+                float scale = dotProduct(e0, e0) * dotProduct(e1, e1);
+                if (dotProduct(diag, diag) <= 1e-8f * area && dotProduct(e0, e1) * dotProduct(e0, e1) <= 1e-8f * scale) {
+                    isRectangle = true;
+                    rectCorner = points[c]; rectEdge0 = e0; rectEdge1 = e1;
+                    return;
+                }
+            }
+        }
     }
 
     Bounds3 getBounds() { return bounding_box; }
@@ -112,10 +152,40 @@ public:
         return intersec;
     }
     
-    // 对三角形网格体的采样，是对其BVH树的采样
+    BVHAccel* getBVH() { return bvh; }
+
+    // 对三角形网格体的采样：用别名表按面积选一个三角形（O(1)），再在三角形上均匀采样
+    // 选中概率A_tri / A乘以三角形上的pdf 1 / A_tri，网格体上的pdf恰为1 / A
     void Sample(Intersection &pos, float &pdf){
-        bvh->Sample(pos, pdf);
+        float pmf;
+        int k = triangleDistribution.sample(get_random_float(), pmf);
+        triangles[k].Sample(pos, pdf);
+        pos.emit = m->getEmission();
+        pdf = 1.0f / area;
+    }
+    // 矩形从参考点ref按立体角采样（球面矩形），其他网格体按面积采样
+    void Sample(const Vector3f &ref, Intersection &pos, float &pdf){
+        if (!isRectangle) { Sample(pos, pdf); return; }
+        SphericalRectangle rect(rectCorner, rectEdge0, rectEdge1, ref);
+        if (rect.area < MIN_SPHERICAL_SAMPLE_AREA || rect.area > MAX_SPHERICAL_SAMPLE_AREA) { Sample(pos, pdf); return; }
+        float u0 = get_random_float(), u1 = get_random_float();
+        pos.coords = rect.sample(ref, u0, u1);
+        pos.normal = triangles[0].normal;
         pos.emit = m->getEmission();
+        pos.obj = this;
+        pdf = rectanglePdf(ref, pos.coords, rect.area);
+    }
+    float Pdf(const Vector3f &ref, const Intersection &pos){
+        if (!isRectangle) return 1.0f / area;
+        SphericalRectangle rect(rectCorner, rectEdge0, rectEdge1, ref);
+        if (rect.area < MIN_SPHERICAL_SAMPLE_AREA || rect.area > MAX_SPHERICAL_SAMPLE_AREA) return 1.0f / area;
+        return rectanglePdf(ref, pos.coords, rect.area);
+    }
+    // 立体角pdf 1 / solidAngle转换为面积度量
+    float rectanglePdf(const Vector3f &ref, const Vector3f &p, float solidAngle){
+        Vector3f d = p - ref;
+        float dis2 = dotProduct(d, d);
+        return std::fabs(dotProduct(triangles[0].normal, d)) / (std::sqrt(dis2) * dis2 * solidAngle);
     }
     float getArea(){
         return area;
@@ -123,6 +193,12 @@ public:
     bool hasEmit(){
         return m->hasEmission();
     }
+    Material* getMaterial(){
+        return m;
+    }
+    void getPrimitives(std::vector<Object*> &primitives){
+        for (auto &tri : triangles) primitives.push_back(&tri);
+    }
     
     // bool intersect(const Ray& ray) { return true; }
 
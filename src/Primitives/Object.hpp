@@ -1,9 +1,13 @@
 #pragma once
+#include <vector>
 #include "Vector.hpp"
 #include "global.hpp"
 #include "Bounds3.hpp"
 #include "Ray.hpp"
 #include "Intersection.hpp"
+#include "DirectionCone.hpp"
+
+class BVHAccel;
 
 class Object
 {
@@ -18,5 +22,16 @@ public:
     virtual Bounds3 getBounds() = 0;
     virtual float getArea() = 0;
     virtual void Sample(Intersection &pos, float &pdf) = 0;
+    // 从参考点ref看去对物体采样（如按立体角采样），pdf仍为面积度量，与按面积采样统一处理；默认按面积采样
+    virtual void Sample(const Vector3f &ref, Intersection &pos, float &pdf) { Sample(pos, pdf); }
+    // 用上面的方式从ref采样到物体上一点pos的pdf（面积度量），用于MIS
+    virtual float Pdf(const Vector3f &ref, const Intersection &pos) { return 1.f / getArea(); }
     virtual bool hasEmit() = 0;
+    virtual Material* getMaterial() = 0;
+    // 发光方向的范围（光源BVH使用），默认朝各个方向发光
+    virtual DirectionCone getEmitCone() { return DirectionCone::EntireSphere(); }
+    // 组成物体的基本图元（如网格体的每个三角形），光源BVH以图元为单位构建
+    virtual void getPrimitives(std::vector<Object*> &primitives) { primitives.push_back(this); }
+    // 物体自身的BVH（如三角形网格体），光线包求交时直接进入该BVH继续遍历；没有则逐条光线求交
+    virtual BVHAccel* getBVH() { return nullptr; }
 };
@@ -4,6 +4,7 @@
 #include "Vector.hpp"
 #include "Bounds3.hpp"
 #include "Material.hpp"
+#include "Sampling.hpp"
 
 class Sphere : public Object{
 public:
@@ -57,6 +58,7 @@ public:
         result.coords = Vector3f(ray.origin + ray.direction * t0);
         result.normal = normalize(Vector3f(result.coords - center));
         result.m = this->m;
+        result.emit = m->getEmission();
         result.obj = this;
         result.distance = t0;
         return result;
@@ -73,21 +75,78 @@ public:
                        Vector3f(center.x+radius, center.y+radius, center.z+radius));
     }
 
-    // 对球面采样，返回采样点和pdf
+    // 对球面均匀采样，返回采样点和pdf
+    // z = cos(theta)在[-1, 1]上均匀分布时球面上的点才是均匀的（直接对极角均匀采样会在两极聚集）
     void Sample(Intersection &pos, float &pdf){
-        // 对球面随机采样一点，以其极坐标来表示
-        float theta = 2.0 * M_PI * get_random_float(), phi = M_PI * get_random_float();
-        Vector3f dir(std::cos(phi), std::sin(phi)*std::cos(theta), std::sin(phi)*std::sin(theta));
+        float z = 1.0f - 2.0f * get_random_float(), phi = 2.0f * M_PI * get_random_float();
+        float r = std::sqrt(std::max(0.f, 1.0f - z * z));
+        Vector3f dir(r * std::cos(phi), r * std::sin(phi), z);
         pos.coords = center + radius * dir;
         pos.normal = dir;
         pos.emit = m->getEmission();
+        pos.obj = this;
         pdf = 1.0f / area;
     }
+
+    // 参考点在球外时，在球对ref张开的锥内均匀采样方向，得到可见球冠上的点；在球内时按面积采样
+    // refer: pbrt-v4 Sphere::Sample
+    void Sample(const Vector3f &ref, Intersection &pos, float &pdf){
+        Vector3f toCenter = center - ref;
+        float dis2 = dotProduct(toCenter, toCenter);
+        if (dis2 <= radius2) { Sample(pos, pdf); return; }
+
+        float dis = std::sqrt(dis2);
+        float sin2ThetaMax = radius2 / dis2, sinThetaMax = std::sqrt(sin2ThetaMax);
+        float cosThetaMax = safeSqrt(1 - sin2ThetaMax);
+        float oneMinusCosThetaMax = 1 - cosThetaMax;
+
+        // 在锥内采样与中心方向的夹角theta，锥很小时用泰勒展开避免精度损失
+        float u0 = get_random_float(), u1 = get_random_float();
+        float cosTheta = (cosThetaMax - 1) * u0 + 1;
+        float sin2Theta = 1 - cosTheta * cosTheta;
+        if (sin2ThetaMax < 0.00068523f) { // sin^2(1.5度)
+            sin2Theta = sin2ThetaMax * u0;
+            cosTheta = std::sqrt(1 - sin2Theta);
+            oneMinusCosThetaMax = sin2ThetaMax / 2;
+        }
+
+        // 由theta求出采样点相对球心的角度alpha，得到球面上的点
+        float cosAlpha = sin2Theta / sinThetaMax + cosTheta * safeSqrt(1 - sin2Theta / sin2ThetaMax);
+        float sinAlpha = safeSqrt(1 - cosAlpha * cosAlpha);
+        float phi = 2.0f * M_PI * u1;
+        Vector3f w = toCenter / dis, b, c;
+        CoordinateSystem(w, b, c);
+        Vector3f n = -(sinAlpha * std::cos(phi) * b + sinAlpha * std::sin(phi) * c + cosAlpha * w);
+        pos.coords = center + radius * n;
+        pos.normal = n;
+        pos.emit = m->getEmission();
+        pos.obj = this;
+        pdf = conePdf(ref, pos.coords, n, oneMinusCosThetaMax);
+    }
+    float Pdf(const Vector3f &ref, const Intersection &pos){
+        Vector3f toCenter = center - ref;
+        float dis2 = dotProduct(toCenter, toCenter);
+        if (dis2 <= radius2) return 1.0f / area;
+        float sin2ThetaMax = radius2 / dis2;
+        float oneMinusCosThetaMax = sin2ThetaMax < 0.00068523f ? sin2ThetaMax / 2 : 1 - safeSqrt(1 - sin2ThetaMax);
+        return conePdf(ref, pos.coords, normalize(pos.coords - center), oneMinusCosThetaMax);
+    }
+    // 立体角pdf 1 / (2pi(1 - cos(thetaMax)))转换为面积度量，背向ref的点不会被采样到
+    float conePdf(const Vector3f &ref, const Vector3f &p, const Vector3f &n, float oneMinusCosThetaMax){
+        Vector3f d = ref - p;
+        float dis2 = dotProduct(d, d);
+        float cosLight = dotProduct(n, d) / std::sqrt(dis2);
+        if (cosLight <= 0.f) return 0.f;
+        return cosLight / (dis2 * 2 * M_PI * oneMinusCosThetaMax);
+    }
     float getArea(){
         return area;
     }
     bool hasEmit(){
         return m->hasEmission();
     }
+    Material* getMaterial(){
+        return m;
+    }
 };
 
@@ -3,6 +3,7 @@
 #include "Intersection.hpp"
 #include "Material.hpp"
 #include "Object.hpp"
+#include "Sampling.hpp"
 
 class Triangle : public Object
 {
@@ -47,14 +48,50 @@ public:
         float x = std::sqrt(get_random_float()), y = get_random_float();
         pos.coords = v0 * (1.0f - x) + v1 * (x * (1.0f - y)) + v2 * (x * y);
         pos.normal = this->normal;
+        pos.emit = m->getEmission();
+        pos.obj = this;
         pdf = 1.0f / area;
     }
+    // 从参考点ref按立体角采样：在三角形所张的球面三角形上均匀采样方向，再求与三角形平面的交点
+    // 立体角过小或过大时退回按面积采样
+    void Sample(const Vector3f &ref, Intersection &pos, float &pdf){
+        float solidAngle = sphericalTriangleArea(v0, v1, v2, ref);
+        if (solidAngle < MIN_SPHERICAL_SAMPLE_AREA || solidAngle > MAX_SPHERICAL_SAMPLE_AREA) {
+            Sample(pos, pdf);
+            return;
+        }
+        pdf = 0.f;
+        float u0 = get_random_float(), u1 = get_random_float();
+        Vector3f w;
+        if (!sampleSphericalTriangle(v0, v1, v2, ref, u0, u1, w)) return;
+        float t = dotProduct(v0 - ref, normal) / dotProduct(w, normal);
+        if (!(t > 0.f)) return;
+        pos.coords = ref + t * w;
+        pos.normal = this->normal;
+        pos.emit = m->getEmission();
+        pos.obj = this;
+        pdf = std::fabs(dotProduct(normal, w)) / (t * t * solidAngle); // 立体角pdf 1 / solidAngle转换为面积度量
+    }
+    float Pdf(const Vector3f &ref, const Intersection &pos){
+        float solidAngle = sphericalTriangleArea(v0, v1, v2, ref);
+        if (solidAngle < MIN_SPHERICAL_SAMPLE_AREA || solidAngle > MAX_SPHERICAL_SAMPLE_AREA) return 1.0f / area;
+        Vector3f d = pos.coords - ref;
+        float dis2 = dotProduct(d, d);
+        return std::fabs(dotProduct(normal, d)) / (std::sqrt(dis2) * dis2 * solidAngle);
+    }
     float getArea(){
         return area;
     }
     bool hasEmit(){
         return m->hasEmission();
     }
+    Material* getMaterial(){
+        return m;
+    }
+    // 光源采样时只有法线一侧可见（costheta_prime > 0），因此只向法线方向的半球发光
+    DirectionCone getEmitCone(){
+        return DirectionCone(normal, 1.f);
+    }
 };
 
 
@@ -0,0 +1,143 @@
+#include <cmath>
+#include <algorithm>
+#include "RadianceCache.hpp"
+
+static void atomicAdd(std::atomic<float> &a, float v)
+{
+    float old = a.load(std::memory_order_relaxed);
+    while (!a.compare_exchange_weak(old, old + v, std::memory_order_relaxed)) {}
+}
+
+// 键值到槽位的混合（splitmix64的最后一步）
+static uint64_t mix(uint64_t k)
+{
+    k = (k ^ (k >> 30)) * 0xbf58476d1ce4e5b9ull;
+    k = (k ^ (k >> 27)) * 0x94d049bb133111ebull;
+    return k ^ (k >> 31);
+}
+
+RadianceCache::RadianceCache(float cellSize, uint32_t capacity) : hits(0), queries(0)
+{
+    invCellSize = 1.f / cellSize;
+    uint32_t size = 1;
+    while (size < capacity) size <<= 1;
+    mask = size - 1;
+    entries = std::vector<Entry>(size);
+    for (auto &e : entries) {
+        e.key = 0;
+        e.sum[0] = e.sum[1] = e.sum[2] = 0.f;
+        e.sumSq = 0.f;
+        for (int a = 0; a < 3; ++a) e.sumP[a] = e.sumPP[a] = e.sumYP[a] = 0.f;
+        e.count = 0;
+    }
+}
+
+// 位置的格子坐标各取17位，法线各分量取round(2n)（-2..2，共125种，约30度一档），最高位置1保证键不为0
+uint64_t RadianceCache::key(const Vector3f &p, const Vector3f &n) const
+{
+    uint64_t x = (uint64_t)(int64_t)std::floor(p.x * invCellSize) & 0x1FFFF;
+    uint64_t y = (uint64_t)(int64_t)std::floor(p.y * invCellSize) & 0x1FFFF;
+    uint64_t z = (uint64_t)(int64_t)std::floor(p.z * invCellSize) & 0x1FFFF;
+    uint64_t nq = (uint64_t)((std::lround(n.x * 2) + 2) * 25 + (std::lround(n.y * 2) + 2) * 5 + (std::lround(n.z * 2) + 2));
+    return (1ull << 60) | (x << 43) | (y << 26) | (z << 9) | nq;
+}
+
+Vector3f RadianceCache::cellOffset(const Vector3f &p) const
+{
+    Vector3f q = p * invCellSize;
+    return Vector3f(q.x - std::floor(q.x), q.y - std::floor(q.y), q.z - std::floor(q.z));
+}
+
+// 各线程的查询统计，属于当前正在查询的缓存
+struct CacheStatistics
+{
+    const RadianceCache *cache = nullptr;
+    uint64_t hits = 0, queries = 0;
+};
+static thread_local CacheStatistics statistics;
+
+static CacheStatistics &threadStatistics(const RadianceCache *cache)
+{
+    if (statistics.cache != cache) statistics = CacheStatistics{cache, 0, 0};
+    return statistics;
+}
+
+void RadianceCache::flushStatistics() const
+{
+    CacheStatistics &s = threadStatistics(this);
+    hits.fetch_add(s.hits, std::memory_order_relaxed);
+    queries.fetch_add(s.queries, std::memory_order_relaxed);
+    s.hits = s.queries = 0;
+}
+
+void RadianceCache::insert(const Vector3f &p, const Vector3f &n, const Vector3f &L)
+{
+    if (!std::isfinite(L.x + L.y + L.z)) return;
+    uint64_t k = key(p, n);
+    uint64_t slot = mix(k);
+    for (int i = 0; i < MAX_PROBES; ++i) {
+        Entry &e = entries[(slot + i) & mask];
+        uint64_t current = e.key.load(std::memory_order_relaxed);
+        if (current == 0) {
+            // 占用空槽；失败时current为其他线程写入的键
+            if (e.key.compare_exchange_strong(current, k, std::memory_order_relaxed)) current = k;
+        }
+        if (current != k) continue;
+        float y = luminance(L);
+        atomicAdd(e.sum[0], L.x);
+        atomicAdd(e.sum[1], L.y);
+        atomicAdd(e.sum[2], L.z);
+        atomicAdd(e.sumSq, y * y);
+        Vector3f o = cellOffset(p);
+        float offset[3] = {o.x, o.y, o.z};
+        for (int a = 0; a < 3; ++a) {
+            atomicAdd(e.sumP[a], offset[a]);
+            atomicAdd(e.sumPP[a], offset[a] * offset[a]);
+            atomicAdd(e.sumYP[a], y * offset[a]);
+        }
+        e.count.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+}
+
+bool RadianceCache::lookup(const Vector3f &p, const Vector3f &n, Vector3f &L) const
+{
+    CacheStatistics &s = threadStatistics(this);
+    s.queries++;
+    uint64_t k = key(p, n);
+    uint64_t slot = mix(k);
+    for (int i = 0; i < MAX_PROBES; ++i) {
+        const Entry &e = entries[(slot + i) & mask];
+        uint64_t current = e.key.load(std::memory_order_relaxed);
+        if (current == 0) return false;
+        if (current != k) continue;
+        uint32_t count = e.count.load(std::memory_order_relaxed);
+        if (count < minSamples) return false;
+        float inv = 1.f / count;
+        L = Vector3f(e.sum[0] * inv, e.sum[1] * inv, e.sum[2] * inv);
+        float mean = luminance(L);
+        float variance = std::max(0.f, e.sumSq * inv - mean * mean);
+        // 按坐标轴分别线性回归亮度与位置，梯度乘以查询点到样本重心的偏移作为偏差；样本在某一轴上几乎不分布（如表面法线方向）时该轴不计
+        Vector3f o = cellOffset(p);
+        float offset[3] = {o.x, o.y, o.z};
+        float bias = 0.f;
+        for (int a = 0; a < 3; ++a) {
+            float meanP = e.sumP[a] * inv;
+            float varP = e.sumPP[a] * inv - meanP * meanP;
+            if (varP < 1e-4f) continue;
+            float gradient = (e.sumYP[a] * inv - mean * meanP) / varP;
+            bias += gradient * (offset[a] - meanP);
+        }
+        if (variance * inv + bias * bias > maxError * maxError * mean * mean) return false;
+        s.hits++;
+        return true;
+    }
+    return false;
+}
+
+uint32_t RadianceCache::cells() const
+{
+    uint32_t n = 0;
+    for (auto &e : entries) n += e.key.load(std::memory_order_relaxed) != 0;
+    return n;
+}
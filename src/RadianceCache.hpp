@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include "Vector.hpp"
+
+// 世界空间的radiance缓存：按量化后的位置（边长cellSize的网格）和法线作为键的哈希网格
+// 只缓存漫反射表面（出射radiance与方向无关）正面的出射radiance（不含自发光）
+// 开放寻址的哈希表，容量固定；插入时对空槽做CAS占用，值用原子加累计，不加锁
+// 查询时只有样本数不少于minSamples、且误差不超过maxError（相对亮度均值）的格子才返回；误差由两部分组成：
+// 均值的标准误差，以及用格子均值代替查询点处radiance的偏差——由格子内样本的位置和亮度线性回归得到梯度，
+// 乘以查询点到样本重心的距离估计，阴影边缘、角落等radiance在格子内变化大的地方因此不会命中
+// maxError越小越接近不使用缓存的结果，越大越多路径可以提前结束
+class RadianceCache
+{
+public:
+    RadianceCache(float cellSize, uint32_t capacity = 1u << 20);
+
+    float maxError = 0.05f;
+    uint32_t minSamples = 16;
+    bool filling = true; // 写入阶段：castRayPT写入而不查询；结束后只查询，缓存不再变化
+
+    // 累加点p（法线n）处的一个出射radiance估计，表满时丢弃；线程安全
+    void insert(const Vector3f &p, const Vector3f &n, const Vector3f &L);
+    // 满足误差要求时返回true，L为格子内的均值；可以与insert并行调用
+    bool lookup(const Vector3f &p, const Vector3f &n, Vector3f &L) const;
+
+    // 统计：被占用的格子数、查询命中数和查询数
+    // 查询数和命中数先累计在各线程自己的计数中，渲染线程结束前调用flushStatistics汇总，避免所有线程争用同一缓存行
+    uint32_t cells() const;
+    void flushStatistics() const;
+    mutable std::atomic<uint64_t> hits, queries;
+
+private:
+    struct Entry
+    {
+        std::atomic<uint64_t> key; // 0表示空槽
+        std::atomic<float> sum[3];
+        std::atomic<float> sumSq; // 亮度的平方和
+        // 样本在格子内的位置（以格子边长为单位，[0, 1)）的和、平方和以及与亮度乘积的和，用于估计格子内的亮度梯度
+        std::atomic<float> sumP[3], sumPP[3], sumYP[3];
+        std::atomic<uint32_t> count;
+    };
+
+    float invCellSize;
+    uint32_t mask;
+    std::vector<Entry> entries;
+
+    uint64_t key(const Vector3f &p, const Vector3f &n) const;
+    Vector3f cellOffset(const Vector3f &p) const;
+    static const int MAX_PROBES = 16; // 线性探测的最大步数
+};
@@ -1,112 +1,412 @@
 #include <fstream>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <algorithm>
 #include "Scene.hpp"
 #include "Renderer.hpp"
 #include "global.hpp"
 #include "Vector.hpp"
+#include "Film.hpp"
+#include "Camera.hpp"
+#include "Wavefront.hpp"
+#include "BDPT.hpp"
+#include "SPPM.hpp"
+#include "Denoiser.hpp"
+#include "AOV.hpp"
 #include <mingw.thread.h>
 #include <mingw.mutex.h>
 
-inline float deg2rad(const float& deg) { return deg * M_PI / 180.0; }
-
 // epsilon值大小会影响结果的亮度，如果太小，会出现横状黑色条纹，原因是直接光部分的精度问题
 const float EPSILON = 0.00016f;
 
+// Ctrl+C时置位，渲染线程在完成当前行后退出，随后保存断点和当前的部分结果
+static std::atomic<bool> interrupted(false);
+
+static void handleInterrupt(int)
+{
+    interrupted = true;
+    std::signal(SIGINT, SIG_DFL); // 再按一次Ctrl+C直接退出
+}
+
+// 一行中连续N个像素的主光线组成光线包求交，再由交点逐像素继续路径追踪
+template<int N>
+static void renderRowPackets(const Scene& scene, const Camera& camera, Film& film, AOVFilm* aovFilm, int j,
+                             uint64_t seed, int sampleBegin, int passBegin, int passEnd)
+{
+    for (int k = passBegin; k < passEnd; ++k) {
+        seed_random((uint32_t)hash_combine(hash_combine(seed, k), j)); // 与逐像素渲染相同，按全局采样序号和行号设定种子
+        for (int i0 = 0; i0 < film.width; i0 += N) {
+            int lanes = std::min(N, film.width - i0);
+            RayPacket<N> packet{};
+            Intersection hits[N];
+            uint32_t mask = 0;
+            for (int l = 0; l < lanes; ++l) {
+                int index = j * film.width + i0 + l;
+                if (sampleBegin + (int)film.sampleCount[index] > k) continue; // 该采样已完成（恢复渲染时）
+                packet.set(l, camera.generateRay(i0 + l + 0.5f, j + 0.5f));
+                mask |= 1u << l;
+            }
+            if (!mask) continue;
+            scene.intersectPacket(packet, hits, mask);
+            for (uint32_t bits = mask; bits; bits &= bits - 1) {
+                int l = __builtin_ctz(bits);
+                int index = j * film.width + i0 + l;
+                AOVSample sample;
+                AOVSample *aov = aovFilm ? &sample : nullptr;
+                film.addSample(index, scene.castRayPT(packet.getRay(l), hits[l], aov)); // path tracing
+                if (aov) aovFilm->add(index, *aov);
+            }
+        }
+    }
+}
+
+// 行[rowBegin, rowEnd)内与参考图的均方根误差（线性radiance，三个分量）
+// 与输出图片相同，只比较[0, 1]内的部分，否则误差几乎全部来自光源等过亮像素边缘的走样
+static float rootMeanSquareError(const Film& film, const Film& reference, int rowBegin, int rowEnd)
+{
+    double sum = 0.0;
+    int count = 0;
+    for (int index = rowBegin * film.width; index < rowEnd * film.width; ++index) {
+        Vector3f a = film.getPixel(index), b = reference.getPixel(index);
+        Vector3f d(clamp(0, 1, a.x) - clamp(0, 1, b.x), clamp(0, 1, a.y) - clamp(0, 1, b.y), clamp(0, 1, a.z) - clamp(0, 1, b.z));
+        sum += d.x * d.x + d.y * d.y + d.z * d.z;
+        count += 3;
+    }
+    return count > 0 ? (float)std::sqrt(sum / count) : 0.f;
+}
+
+uint64_t Renderer::hash(const Scene& scene) const
+{
+    uint64_t h = scene.hash();
+    h = hash_bytes(&eye_pos, sizeof(eye_pos), h);
+    h = hash_bytes(&integrator, sizeof(integrator), h);
+    return h;
+}
+
 // The main render function. This where we iterate over all pixels in the image,
 // generate primary rays and cast these rays into the scene. The content of the
 // framebuffer is saved to a file.
-void Renderer::Render(const Scene& scene)
+bool Renderer::Render(const Scene& scene)
 {
-    std::vector<Vector3f> framebuffer(scene.width * scene.height);
+    Film film(scene.width, scene.height);
+    Camera camera(eye_pos, scene.width, scene.height, scene.fov);
+    WavefrontIntegrator wavefront(scene, camera, thread_num);
+    wavefront.packetSize = packetSize;
+    BDPTIntegrator bdpt(scene, camera);
+    SPPMIntegrator sppm(scene, camera, thread_num);
+    sppm.photonsPerIteration = photonsPerIteration;
+    sppm.initialRadius = photonRadius;
+
+    FilmHeader header;
+    header.sceneHash = hash(scene);
+    header.seed = seed;
+    header.spp = spp;
+    header.passSpp = passSpp;
+    header.rowBegin = std::min(std::max(0, rowBegin), scene.height);
+    header.rowEnd = rowEnd < 0 ? scene.height : std::min(std::max<int>(header.rowBegin, rowEnd), scene.height);
+    header.sampleBegin = std::max(0, sampleBegin);
+    header.sampleEnd = sampleEnd < 0 ? std::max<int>(spp, header.sampleBegin) : std::max<int>(sampleEnd, header.sampleBegin);
 
-    float scale = tan(deg2rad(scene.fov * 0.5));
-    float imageAspectRatio = scene.width / (float)scene.height;
-    Vector3f eye_pos(278, 273, -800);
-    int m = 0;
+    if (resume && integrator == Integrator::SPPM) {
+        std::cerr << "SPPM does not support resuming from a checkpoint\n";
+        return false;
+    }
+    // 路径引导的SD-tree只在内存中训练，不写入断点和部分结果，恢复或分片后从未训练的状态开始，与一次渲染完的结果不同
+    bool sharded = header.rowBegin > 0 || header.rowEnd < scene.height || header.sampleBegin > 0;
+    if (scene.usePathGuiding && (resume || sharded)) {
+        std::cerr << "Path guiding does not support resuming from a checkpoint or sharding\n";
+        return false;
+    }
+    // radiance缓存同样只存在于内存中，在渲染开始的若干轮写入
+    if (scene.radianceCachePasses > 0 && (resume || sharded)) {
+        std::cerr << "The radiance cache does not support resuming from a checkpoint or sharding\n";
+        return false;
+    }
+    // 缓存只存表面的出射radiance，查到时直接代替下一段光线的castRayPT，会跳过这段光线上的介质
+    if (scene.radianceCachePasses > 0 && !scene.media.empty()) {
+        std::cerr << "The radiance cache does not support participating media\n";
+        return false;
+    }
+    // 每个像素的收集半径随迭代逐步缩小，从中途开始的采样范围无法复现一次渲染完的结果
+    if (integrator == Integrator::SPPM && header.sampleBegin > 0) {
+        std::cerr << "SPPM does not support sharding by sample range, shard by rows instead\n";
+        return false;
+    }
+    if (resume) {
+        FilmHeader saved;
+        if (!film.load(checkpointPath, saved)) return false;
+        if (saved.sceneHash != header.sceneHash) {
+            std::cerr << "Checkpoint " << checkpointPath << " does not match the current scene/settings\n";
+            return false;
+        }
+        if (saved.rowBegin != header.rowBegin || saved.rowEnd != header.rowEnd || saved.sampleBegin != header.sampleBegin) {
+            std::cerr << "Checkpoint " << checkpointPath << " belongs to a different shard\n";
+            return false;
+        }
+        // 沿用断点中的种子和每轮采样数，保证每个采样每一行的随机序列与中断前一致
+        header.seed = saved.seed;
+        header.passSpp = saved.passSpp;
+        std::cout << "Resuming from " << checkpointPath << "\n";
+    }
+
+    std::unique_ptr<AOVFilm> aovFilm;
+    if (aovs && integrator == Integrator::PATH) aovFilm = std::make_unique<AOVFilm>(scene, scene.width, scene.height, aovs);
+    else if (aovs) std::cerr << "AOVs are only supported by the path integrator, skipping " << aovPath << "\n";
+
+    std::unique_ptr<Film> reference;
+    if (!referencePath.empty()) {
+        reference = std::make_unique<Film>(scene.width, scene.height);
+        FilmHeader referenceHeader;
+        if (!reference->load(referencePath, referenceHeader)) return false;
+    }
 
     // change the spp value to change sample ammount
-    int spp = 256; // 每个pixel路径数
     std::cout << "SPP: " << spp << "\n";
 
-    int thread_num = 8; // 线程数
-    int thread_height = scene.height / thread_num; // 每个线程处理的高度/行数
+    // 像素下一个要采样的序号 = sampleBegin + 已完成的采样数，从分片内所有像素都未完成的那一轮开始
+    // 随机序列按全局采样序号设定，因此不同采样范围的分片不会用到相同的随机序列，合并后与不分片的结果一致
+    int rowFirst = header.rowBegin, rowLast = header.rowEnd;
+    int passSamples = header.passSpp;
+    int passNum = (header.sampleEnd + passSamples - 1) / passSamples;
+    uint32_t minCount = rowFirst < rowLast ? *std::min_element(film.sampleCount.begin() + rowFirst * scene.width,
+                                                               film.sampleCount.begin() + rowLast * scene.width) : 0;
+    int firstPass = (header.sampleBegin + minCount) / passSamples;
+
     std::vector<std::thread> threads(thread_num);
     std::mutex mtx;
     int progress = 0;
-
-    bool isBasic = false; // 是否使用whitted-style ray tracing
+    int totalRows = std::max(1, (passNum - firstPass) * (rowLast - rowFirst));
+    std::atomic<int> nextRow(rowFirst);
+    int pass = firstPass;
 
     // 使用lamdba表达式定义函数对象，描述每个线程的任务
-    auto renderEachRow = [&](int thread_index){
-        int start = thread_index * thread_height;
-        int end = (thread_index + 1) * thread_height;
-        for (uint32_t j = start; j < end; ++j) {
-            for (uint32_t i = 0; i < scene.width; ++i) {
-                // generate primary ray direction
-                // float x = (2 * (i + get_random_float()) / (float)scene.width - 1) *
-                //         imageAspectRatio * scale;
-                // float y = (1 - 2 * (j + get_random_float()) / (float)scene.height) * scale;
-
-                // float x = (2 * (i + 0.5) / (float)scene.width - 1) *
-                //         imageAspectRatio * scale;
-                // float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
-
-                //Vector3f dir = Vector3f(-x, y, 1).normalized();
-
-                // MSAA抗锯齿
-                int num = std::ceil(sqrt(spp));
-                float invNum = 1.f / num;
-                float invNumHalf = invNum * 0.5f;
-
-                for (int k = 0; k < spp; k++){
+    // 每个线程不断领取下一行进行渲染，直到本轮所有行都领取完毕或者被中断
+    int passBegin = 0, passEnd = 0;
+    auto renderEachRow = [&](){
+        for (int j = nextRow++; j < rowLast && !interrupted; j = nextRow++) {
+            if (integrator == Integrator::PATH && packetSize > 1) {
+                switch (packetSize) {
+                    case 4: renderRowPackets<4>(scene, camera, film, aovFilm.get(), j, header.seed, header.sampleBegin, passBegin, passEnd); break;
+                    case 16: renderRowPackets<16>(scene, camera, film, aovFilm.get(), j, header.seed, header.sampleBegin, passBegin, passEnd); break;
+                    default: renderRowPackets<8>(scene, camera, film, aovFilm.get(), j, header.seed, header.sampleBegin, passBegin, passEnd); break;
+                }
+            }
+            else for (int k = passBegin; k < passEnd; ++k) {
+                // 每一行第k个采样的随机序列只由种子、全局采样序号和行号决定，
+                // 因此恢复渲染、按行或按采样范围分片时都与一次渲染完的结果一致
+                seed_random((uint32_t)hash_combine(hash_combine(header.seed, k), j));
+                for (uint32_t i = 0; i < scene.width; ++i) {
+                    // generate primary ray direction
+                    // float x = (2 * (i + get_random_float()) / (float)scene.width - 1) *
+                    //         imageAspectRatio * scale;
+                    // float y = (1 - 2 * (j + get_random_float()) / (float)scene.height) * scale;
+
+                    // float x = (2 * (i + 0.5) / (float)scene.width - 1) *
+                    //         imageAspectRatio * scale;
+                    // float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
+
+                    //Vector3f dir = Vector3f(-x, y, 1).normalized();
+
+                    // MSAA抗锯齿
+                    int num = std::ceil(sqrt(spp));
+                    float invNum = 1.f / num;
+                    float invNumHalf = invNum * 0.5f;
+
+                    int index = j * scene.width + i;
+                    if (header.sampleBegin + (int)film.sampleCount[index] > k) continue; // 该采样已完成（恢复渲染时）
+                    if (integrator == Integrator::BDPT) {
+                        // 每个采样追踪一条光源子路径，它的splat按整张图的光路数归一化
+                        film.addSample(index, bdpt.Li(i, j, film));
+                        film.lightPaths++;
+                        continue;
+                    }
                     float screen_i = i + invNumHalf + invNum * (k % num);
                     float screen_j = j + invNumHalf + invNum * (k / num);
                     // 从屏幕像素坐标转换到[-1，1]再转换为相机坐标系下的坐标
-                    // float x = ((2 * screen_i / (float)scene.width) - 1) *
-                    //         imageAspectRatio * scale;
-                    // float y = (1 - (2 * screen_j / (float)scene.height)) * scale;
-                    // 因为认为相机的始终朝向z轴，因此无论相机在哪个位置，dir都可以按照相机在原点计算，即在相机坐标系下计算（如果相机朝向不是这样，那dir可能要进行坐标系转换，从相机坐标系转换到世界坐标系）
-                    float x = (2 * (i + 0.5) / (float)scene.width - 1) *
-                            imageAspectRatio * scale;
-                    float y = (1 - 2 * (j + 0.5) / (float)scene.height) * scale;
-                    Vector3f dir = normalize(Vector3f(-x, y, 1));
-
-                    if(isBasic){
-                        framebuffer[(int)(j * scene.width + i)] += scene.castRayBasic(Ray(eye_pos, dir)) / spp; // whitted-style tracing
+                    // Ray ray = camera.generateRay(screen_i, screen_j);
+                    Ray ray = camera.generateRay(i + 0.5f, j + 0.5f);
+
+                    if(integrator == Integrator::WHITTED){
+                        film.addSample(index, scene.castRayBasic(ray)); // whitted-style tracing
                     }else{
-                        framebuffer[(int)(j * scene.width + i)] += scene.castRayPT(Ray(eye_pos, dir)) / spp; // path tracing
+                        AOVSample sample;
+                        AOVSample *aov = aovFilm ? &sample : nullptr;
+                        film.addSample(index, scene.castRayPT(ray, aov)); // path tracing
+                        if (aov) aovFilm->add(index, *aov);
                     }
                 }
             }
 
             mtx.lock(); // 一行渲染完成后更新进度条
             progress++;
-            UpdateProgress(progress / (float)scene.height);
+            UpdateProgress(progress / (float)totalRows);
             mtx.unlock();
         }
+        if (scene.radianceCache) scene.radianceCache->flushStatistics(); // 汇总本线程的缓存查询统计
     };
 
-    // 给线程分配任务
-    for(int i = 0; i < thread_num; ++i){
-        threads[i] = std::thread(renderEachRow, i);
+    auto previousHandler = std::signal(SIGINT, handleInterrupt);
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+    auto renderStart = lastCheckpoint;
+    bool converged = false;
+    bool checkpointSaved = false; // 最后一轮结束时是否保存了断点
+
+    for (; pass < passNum && !interrupted; ++pass) {
+        passBegin = std::max<int>(pass * passSamples, header.sampleBegin);
+        passEnd = std::min<int>((pass + 1) * passSamples, header.sampleEnd);
+
+        if (integrator == Integrator::WAVEFRONT) {
+            // wavefront每次处理一个采样序号下的若干行，批内部并行，每批结束后检查是否被中断
+            // 批按全局行号对齐，种子只由全局采样序号和批号决定，按采样范围分片时与一次渲染完的结果一致
+            int batchRows = std::max(1, wavefront.maxPaths / (int)scene.width);
+            for (int k = passBegin; k < passEnd && !interrupted; ++k) {
+                for (int j = rowFirst; j < rowLast && !interrupted; ) {
+                    int block = j / batchRows;
+                    int batchEnd = std::min(rowLast, (block + 1) * batchRows);
+                    wavefront.render(film, j, batchEnd, header.sampleBegin, k, k + 1,
+                                     hash_combine(hash_combine(header.seed, k), block));
+                    if (k + 1 == passEnd) {
+                        progress += batchEnd - j;
+                        UpdateProgress(progress / (float)totalRows);
+                    }
+                    j = batchEnd;
+                }
+            }
+        } else if (integrator == Integrator::SPPM) {
+            // 每一轮都作用于整个分片，轮内部并行
+            for (int k = passBegin; k < passEnd && !interrupted; ++k)
+                sppm.iterate(film, rowFirst, rowLast, hash_combine(header.seed, k));
+            progress += rowLast - rowFirst;
+            UpdateProgress(progress / (float)totalRows);
+        } else {
+            nextRow = rowFirst;
+            // 给线程分配任务
+            for(int i = 0; i < thread_num; ++i){
+                threads[i] = std::thread(renderEachRow);
+            }
+            for(int i = 0; i < thread_num; ++i){
+                threads[i].join();
+            }
+        }
+
+        // 路径引导的训练周期依次为1, 2, 4, ...轮，即在第1, 3, 7, 15, ...轮（trainedPasses + 1为2的幂）结束时更新SD-tree（只有castRayPT使用）
+        int trainedPasses = pass - firstPass + 1;
+        if (scene.guiding && !interrupted && ((trainedPasses + 1) & trainedPasses) == 0) scene.guiding->update();
+        // radiance缓存在前radianceCachePasses轮写入，之后只查询
+        if (scene.radianceCache && scene.radianceCache->filling && trainedPasses >= scene.radianceCachePasses) {
+            scene.radianceCache->filling = false;
+            std::cout << "\nRadiance cache: " << scene.radianceCache->cells() << " cells\n";
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (reference && !interrupted) {
+            float error = rootMeanSquareError(film, *reference, rowFirst, rowLast);
+            std::cout << "\nPass " << pass + 1 << ": " << std::chrono::duration<float>(now - renderStart).count()
+                      << " s, RMSE " << error << "\n";
+            converged = targetError > 0.f && error <= targetError;
+        }
+
+        // 两轮之间保存断点，最多损失checkpointInterval秒加一轮的计算量
+        bool lastPass = pass + 1 == passNum || converged;
+        checkpointSaved = false;
+        if (!checkpointPath.empty() && (lastPass || interrupted ||
+            std::chrono::duration<float>(now - lastCheckpoint).count() >= checkpointInterval)) {
+            checkpointSaved = film.save(checkpointPath, header);
+            lastCheckpoint = now;
+        }
+        if (converged) {
+            std::cout << "Reached RMSE " << targetError << " after pass " << pass + 1 << "\n";
+            break;
+        }
     }
-    for(int i = 0; i < thread_num; ++i){
-        threads[i].join();
+
+    std::signal(SIGINT, previousHandler == SIG_ERR ? SIG_DFL : previousHandler);
+
+    if (interrupted) {
+        if (!checkpointSaved) std::cout << "\nRender interrupted, no checkpoint saved\n";
+        else std::cout << "\nRender interrupted, checkpoint saved to " << checkpointPath << "\n";
+    } else {
+        UpdateProgress(1.f);
+    }
+
+    if (integrator == Integrator::WAVEFRONT) wavefront.printStats();
+    if (scene.radianceCache && scene.radianceCache->queries > 0) {
+        std::cout << "Radiance cache hits: " << scene.radianceCache->hits << " / " << scene.radianceCache->queries << "\n";
     }
-    
-    UpdateProgress(1.f);
 
     // save framebuffer to file
-    FILE* fp = fopen("pathTracing.ppm", "wb");
-    (void)fprintf(fp, "P6\n%d %d\n255\n", scene.width, scene.height);
-    for (auto i = 0; i < scene.height * scene.width; ++i) {
-        static unsigned char color[3];
-        // gamma correction
-        //framebuffer[i] = pow(framebuffer[i], 1 / GAMMA_C); 
-        
-        color[0] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].x), 0.6f));
-        color[1] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].y), 0.6f));
-        color[2] = (unsigned char)(255 * std::pow(clamp(0, 1, framebuffer[i].z), 0.6f));
-        fwrite(color, 1, 3, fp);
-    }
-    fclose(fp);    
+    if (!interrupted) writeImage(scene, film, rowFirst, rowLast);
+    else film.writePPM(outputPath);
+    if (!partialPath.empty()) film.save(partialPath, header);
+    if (aovFilm) aovFilm->writeEXR(aovPath, film, rowFirst, rowLast);
+    return !interrupted;
+}
+
+void Renderer::writeImage(const Scene& scene, const Film& film, int rowBegin, int rowEnd) const
+{
+    if (!denoise || integrator == Integrator::SPPM) {
+        film.writePPM(outputPath);
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    Camera camera(eye_pos, scene.width, scene.height, scene.fov);
+    Denoiser denoiser(scene.width, scene.height, thread_num);
+    denoiser.iterations = denoiseIterations;
+    denoiser.collectFeatures(scene, camera, rowBegin, rowEnd);
+    std::vector<Vector3f> color(scene.width * scene.height);
+    std::vector<float> variance(scene.width * scene.height);
+    for (int i = 0; i < scene.width * scene.height; ++i) {
+        color[i] = film.getPixel(i);
+        variance[i] = film.variance(i);
+    }
+    denoiser.denoise(color, variance, rowBegin, rowEnd);
+    Film::writePPM(outputPath, scene.width, scene.height, color);
+    std::cout << "Denoised in " << std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count() << " s\n";
+}
+
+bool Renderer::Merge(const Scene& scene, const std::vector<std::string>& partials)
+{
+    Film result(scene.width, scene.height);
+    std::vector<FilmHeader> headers;
+    uint64_t sceneHash = hash(scene);
+
+    for (auto &path : partials) {
+        Film part(scene.width, scene.height);
+        FilmHeader header;
+        if (!part.load(path, header)) return false;
+        if (header.sceneHash != sceneHash) {
+            std::cerr << path << " was rendered from a different scene/settings\n";
+            return false;
+        }
+        // 相同种子下行范围和采样范围都重叠的分片使用了相同的随机序列，合并后会重复计入相同的采样
+        for (auto &other : headers) {
+            bool rowsOverlap = header.rowBegin < other.rowEnd && other.rowBegin < header.rowEnd;
+            bool samplesOverlap = header.sampleBegin < other.sampleEnd && other.sampleBegin < header.sampleEnd;
+            if (header.seed == other.seed && rowsOverlap && samplesOverlap) {
+                std::cerr << path << " overlaps another partial rendered with the same seed\n";
+                return false;
+            }
+        }
+        headers.push_back(header);
+        result.merge(part);
+        std::cout << "Merged " << path << ": rows [" << header.rowBegin << ", " << header.rowEnd
+                  << "), samples [" << header.sampleBegin << ", " << header.sampleEnd << ")\n";
+    }
+
+    auto range = std::minmax_element(result.sampleCount.begin(), result.sampleCount.end());
+    std::cout << "Samples per pixel: " << *range.first << " - " << *range.second << "\n";
+
+    writeImage(scene, result, 0, scene.height);
+    if (!partialPath.empty()) {
+        FilmHeader header;
+        header.sceneHash = sceneHash;
+        header.seed = seed;
+        header.spp = *range.second;
+        header.passSpp = passSpp;
+        header.rowEnd = scene.height;
+        header.sampleEnd = *range.second;
+        result.save(partialPath, header);
+    }
+    return true;
 }
@@ -1,8 +1,67 @@
 #pragma once
 
+#include <string>
+#include <vector>
 #include "Scene.hpp"
 
+class Film;
+
+enum class Integrator { PATH, WHITTED, WAVEFRONT, BDPT, SPPM };
+
 class Renderer{
 public:
-    void Render(const Scene& scene);
+    // setting up options
+    int spp = 256; // 每个pixel路径数
+    int passSpp = 4; // 每一轮(pass)每个像素的采样数，断点在两轮之间保存
+    int thread_num = 8; // 线程数
+    Integrator integrator = Integrator::PATH; // WHITTED即whitted-style ray tracing，WAVEFRONT为分阶段批处理的路径追踪，BDPT为双向路径追踪，SPPM为随机渐进式光子映射
+    int packetSize = 8; // 主光线/阴影光线组成光线包的大小（4/8/16），小于等于1时逐条光线求交
+    uint32_t seed = 0; // 随机数种子，每一轮每一行的种子由它派生
+    Vector3f eye_pos = Vector3f(278, 273, -800);
+
+    std::string outputPath = "pathTracing.ppm";
+
+    // 断点续渲
+    std::string checkpointPath = "pathTracing.ckpt"; // 为空则不保存断点；分片渲染时默认名（及outputPath、aovPath）带上行/采样范围，见main.cpp
+    float checkpointInterval = 120.f; // 两次保存断点的最小间隔（秒）
+    bool resume = false; // 是否从断点文件继续渲染
+
+    // 分布式渲染：只渲染行[rowBegin, rowEnd)中采样序号在[sampleBegin, sampleEnd)的采样
+    // 负数表示不限制（行到图像底部，采样到spp）
+    int rowBegin = 0, rowEnd = -1;
+    int sampleBegin = 0, sampleEnd = -1;
+    std::string partialPath; // 不为空时把带采样数的浮点结果保存到该文件，供Merge合并
+
+    // 等误差用时：referencePath为参考图（高采样数渲染的部分结果文件），不为空时每一轮结束后输出已用时间和与参考图的RMSE
+    // targetError大于0时RMSE不超过它即停止，比较不同积分器达到相同误差所需的时间
+    std::string referencePath;
+    float targetError = 0.f;
+
+    // SPPM：每个采样即一轮光子映射，photonsPerIteration为每轮发射的光子数（0表示与像素数相同）
+    // photonRadius为初始收集半径（0表示场景包围球半径的1%）；像素的光子统计量不在断点中，不能断点续渲
+    int photonsPerIteration = 0;
+    float photonRadius = 0.f;
+
+    // 渲染结束后用反照率/法线/深度特征和像素方差做边缘保持的à-trous降噪，输出降噪后的图片（部分结果文件仍保存原始数据）
+    // SPPM没有逐采样的方差，不降噪
+    bool denoise = false;
+    int denoiseIterations = 5;
+
+    // AOV：aovs为AOVFlag的组合，非0时与主图在同一轮中累加，渲染结束后连同主图写到aovPath（多图层OpenEXR）
+    // 只有路径追踪积分器（castRayPT）支持；不开启时不分配缓冲，castRayPT中只多一次空指针判断
+    uint32_t aovs = 0;
+    std::string aovPath = "pathTracing.exr";
+
+    // 场景和影响结果的设置共同决定的哈希（spp和分片不计入，因此可以追加采样、分片合并）
+    uint64_t hash(const Scene& scene) const;
+
+    // 返回false表示渲染未能开始（如断点文件与场景不一致）或被中断
+    bool Render(const Scene& scene);
+
+    // 合并任意个部分结果，按每个像素的采样数加权，输出到outputPath（以及partialPath）
+    bool Merge(const Scene& scene, const std::vector<std::string>& partials);
+
+private:
+    // 把film的行[rowBegin, rowEnd)输出到outputPath，开启denoise时先降噪
+    void writeImage(const Scene& scene, const Film& film, int rowBegin, int rowEnd) const;
 };
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Intersection.hpp"
+
+// 加权蓄水池采样（weighted reservoir sampling），用于重采样重要性采样（RIS）
+// 依次输入候选样本及其权重，只保存当前选中的一个样本，第k个候选以w_k / (w_1 + ... + w_k)的概率替换它，
+// 最终每个候选被选中的概率正比于权重，且不需要保存所有候选
+// refer: Spatiotemporal reservoir resampling for real-time ray tracing with dynamic direct lighting (Bitterli et al. 2020)
+struct Reservoir
+{
+    Intersection y; // 选中的光源样本（位置、法线、radiance；obj为空表示环境光）
+    float pHat = 0.f; // 选中样本的目标函数值（未遮挡时贡献的亮度）
+    float wSum = 0.f; // 候选权重之和
+    float M = 0.f; // 参与的候选数
+    float W = 0.f; // 无偏贡献权重，期望为1 / p(y)，贡献为f(y) * W
+
+    // 输入一个候选，u为[0, 1)的随机数，返回是否选中
+    bool update(const Intersection &x, float w, float pHat_x, float u)
+    {
+        wSum += w;
+        M += 1.f;
+        if (w > 0.f && u * wSum < w) {
+            y = x;
+            pHat = pHat_x;
+            return true;
+        }
+        return false;
+    }
+
+    // 合并另一个蓄水池r，pHat_y为r的样本在当前着色点的目标函数值；r相当于M个候选，权重为pHat_y * W * M
+    bool merge(const Reservoir &r, float pHat_y, float u)
+    {
+        float m = M;
+        bool selected = update(r.y, pHat_y * r.W * r.M, pHat_y, u);
+        M = m + r.M;
+        return selected;
+    }
+
+    // 所有候选输入后计算W = wSum / (M * pHat(y))
+    void finalize() { W = pHat > 0.f && M > 0.f ? wSum / (M * pHat) : 0.f; }
+};
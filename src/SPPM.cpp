@@ -0,0 +1,276 @@
+#include <atomic>
+#include <algorithm>
+#include "SPPM.hpp"
+#include "ShadingBatch.hpp"
+#include "global.hpp"
+#include <mingw.thread.h>
+
+static const int PHOTON_CHUNK_SIZE = 4096; // 每块发射的光子数
+
+void PhotonGrid::build(const std::vector<std::vector<Photon> > &chunks, float size)
+{
+    cellSize = size;
+    size_t total = 0;
+    for (auto &chunk : chunks) total += chunk.size();
+    uint32_t tableSize = 1;
+    while (tableSize < total) tableSize <<= 1;
+    mask = tableSize - 1;
+
+    // 计数排序：统计每个哈希值的光子数，前缀和得到起始位置，再把光子放到各自的位置
+    std::vector<uint32_t> hashes;
+    hashes.reserve(total);
+    cellStart.assign(tableSize + 1, 0);
+    for (auto &chunk : chunks) {
+        for (auto &photon : chunk) {
+            uint32_t h = hash(cell(photon.p.x), cell(photon.p.y), cell(photon.p.z));
+            hashes.push_back(h);
+            cellStart[h + 1]++;
+        }
+    }
+    for (uint32_t h = 0; h < tableSize; ++h) cellStart[h + 1] += cellStart[h];
+    photons.resize(total);
+    std::vector<uint32_t> next(cellStart.begin(), cellStart.end() - 1);
+    size_t k = 0;
+    for (auto &chunk : chunks)
+        for (auto &photon : chunk) photons[next[hashes[k++]]++] = photon;
+}
+
+SPPMIntegrator::SPPMIntegrator(const Scene &scene, const Camera &camera, int thread_num)
+    : scene(scene), camera(camera), thread_num(thread_num) {}
+
+template<typename Task>
+void SPPMIntegrator::parallelFor(int count, uint64_t stageSeed, const Task &task)
+{
+    std::atomic<int> next(0);
+    auto worker = [&](){
+        for (int i = next++; i < count; i = next++) {
+            seed_random((uint32_t)hash_combine(stageSeed, i));
+            task(i);
+        }
+    };
+    int workerNum = std::min(thread_num, count);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < workerNum; ++i) threads.emplace_back(worker);
+    worker(); // 当前线程也参与计算
+    for (auto &t : threads) t.join();
+}
+
+bool SPPMIntegrator::sampleSpecular(const Intersection &inter, const Vector3f &wo, Vector3f &wi, Vector3f &beta) const
+{
+    Vector3f n = normalize(inter.normal);
+    if (inter.m->getType() == MIRROR) {
+        wi = normalize(sampleMaterial(scene.materials, inter.m, wo, n));
+        float pdf = pdfMaterial(scene.materials, inter.m, wi, wo, n);
+        beta = pdf > 0.f ? beta * evalMaterial(scene.materials, inter.m, wi, wo, n, inter.tcoords) * std::fabs(dotProduct(wi, n)) / pdf
+                         : Vector3f(0.f);
+        return true;
+    }
+    if (inter.m->getType() == TRANSPARENT) {
+        // 与whitted-style相同按fresnel系数组合反射和折射，这里按系数随机选择其一，beta不变
+        Vector3f reflectDir, refractDir;
+        inter.m->getReflectRefract(wo, n, reflectDir, refractDir);
+        float kr = inter.m->pdf(reflectDir, wo, n);
+        wi = get_random_float() < kr ? reflectDir : refractDir;
+        return true;
+    }
+    return false;
+}
+
+// 偏移起点，避免与起点所在的表面自交
+static Ray offsetRay(const Vector3f &p, const Vector3f &n, const Vector3f &dir)
+{
+    return Ray(dotProduct(dir, n) > 0 ? p + n * EPSILON : p - n * EPSILON, dir);
+}
+
+void SPPMIntegrator::generateVisiblePoints(int rowBegin, int rowEnd, uint64_t seed)
+{
+    parallelFor(rowEnd - rowBegin, seed, [&](int row) {
+        int j = rowBegin + row;
+        for (int i = 0; i < camera.width; ++i) {
+            SPPMPixel &pixel = pixels[j * camera.width + i];
+            pixel.valid = false;
+            Ray ray = camera.generateRay(i + get_random_float(), j + get_random_float());
+            Vector3f beta(1.f);
+            for (int depth = 0; depth <= maxDepth; ++depth) {
+                Intersection inter = scene.intersect(ray);
+                if (!inter.happened) {
+                    pixel.Ld += beta * scene.background(ray.direction);
+                    break;
+                }
+                Vector3f p = inter.coords, n = inter.normal.normalized(), wo = -ray.direction;
+                if (inter.m->hasEmission()) {
+                    if (dotProduct(n, wo) > 0.f) pixel.Ld += beta * inter.m->getEmission();
+                    break;
+                }
+                Vector3f wi;
+                if (sampleSpecular(inter, wo, wi, beta)) {
+                    if (beta.x + beta.y + beta.z <= 0.f) break;
+                    ray = offsetRay(p, n, wi);
+                    continue;
+                }
+
+                // 第一个非镜面着色点：光源采样计算直接光照，间接光照由光子估计
+                Intersection lightPoint;
+                float pdf = 0.f;
+                scene.sampleLight(p, n, lightPoint, pdf);
+                if (pdf > 0.f) {
+                    Vector3f toLight = lightPoint.coords - p;
+                    float dis = toLight.norm();
+                    Intersection shadowInter = scene.intersect(offsetRay(p, n, toLight / dis));
+                    bool unoccluded = lightPoint.obj ? shadowInter.happened && fabs(shadowInter.distance - dis) < 0.01
+                                                     : !shadowInter.happened;
+                    if (unoccluded)
+                        pixel.Ld += beta * scene.unshadowedLight(p, n, wo, inter.m, inter.tcoords, lightPoint) / pdf;
+                }
+                pixel.valid = true;
+                pixel.p = p;
+                pixel.n = n;
+                pixel.wo = wo;
+                pixel.beta = beta;
+                pixel.m = inter.m;
+                pixel.tcoords = inter.tcoords;
+                break;
+            }
+        }
+    });
+}
+
+void SPPMIntegrator::tracePhotons(int count, uint64_t seed)
+{
+    int chunkNum = (count + PHOTON_CHUNK_SIZE - 1) / PHOTON_CHUNK_SIZE;
+    photonChunks.resize(chunkNum);
+    const AliasTable &lights = scene.lightDistribution;
+    parallelFor(chunkNum, seed, [&](int c) {
+        std::vector<Photon> &photons = photonChunks[c];
+        photons.clear();
+        if (lights.empty()) return;
+        int num = std::min(PHOTON_CHUNK_SIZE, count - c * PHOTON_CHUNK_SIZE);
+        for (int k = 0; k < num; ++k) {
+            // 按功率选择光源，光源上按面积、方向按余弦分布采样
+            float pmf;
+            int light = lights.sample(get_random_float(), pmf);
+            Ray ray(Vector3f(0.f), Vector3f(0.f, 0.f, 1.f));
+            Vector3f beta;
+            if (light == (int)scene.emitters.size()) {
+                // 环境光：在场景包围球外、垂直于采样方向w的圆盘上均匀选起点，光子沿-w射入场景
+                Vector3f w;
+                float dirPdf;
+                Vector3f Le = scene.environment->Sample(get_random_float(), get_random_float(), w, dirPdf);
+                if (dirPdf <= 0.f) continue;
+                Vector3f b, t;
+                CoordinateSystem(w, b, t);
+                float r = scene.sceneRadius * std::sqrt(get_random_float()), phi = 2 * M_PI * get_random_float();
+                Vector3f origin = scene.sceneCenter + scene.sceneRadius * w + r * std::cos(phi) * b + r * std::sin(phi) * t;
+                ray = Ray(origin, -w);
+                beta = Le * (M_PI * scene.sceneRadius * scene.sceneRadius) / (pmf * dirPdf);
+            } else {
+                Intersection pos;
+                float pdfPos;
+                scene.emitters[light]->Sample(pos, pdfPos);
+                if (pdfPos <= 0.f) continue;
+                Vector3f n = pos.normal.normalized(), b, t;
+                CoordinateSystem(n, b, t);
+                float r = std::sqrt(get_random_float()), phi = 2 * M_PI * get_random_float();
+                float z = std::sqrt(std::max(0.f, 1 - r * r));
+                Vector3f w = normalize(r * std::cos(phi) * b + r * std::sin(phi) * t + z * n);
+                ray = offsetRay(pos.coords, n, w);
+                // Le * cos / (pmf * pdfPos * cos / pi)
+                beta = pos.emit * M_PI / (pmf * pdfPos);
+            }
+
+            for (int depth = 0; depth <= maxDepth; ++depth) {
+                Intersection inter = scene.intersect(ray);
+                if (!inter.happened || inter.m->hasEmission()) break;
+                Vector3f p = inter.coords, n = inter.normal.normalized(), wo = -ray.direction;
+                Vector3f wi;
+                if (sampleSpecular(inter, wo, wi, beta)) {
+                    if (beta.x + beta.y + beta.z <= 0.f) break;
+                    ray = offsetRay(p, n, wi);
+                    continue;
+                }
+                // 第一次击中即直接光照，已由可见点的光源采样计入
+                if (depth > 0) photons.push_back({p, wo, beta});
+
+                wi = normalize(sampleMaterial(scene.materials, inter.m, wo, n));
+                float pdf = pdfMaterial(scene.materials, inter.m, wi, wo, n);
+                if (pdf <= 0.f) break;
+                // 光子从wo方向到达，沿wi离开
+                beta = beta * evalMaterial(scene.materials, inter.m, wo, wi, n, inter.tcoords) * std::fabs(dotProduct(wi, n)) / pdf;
+                if (depth >= 3) {
+                    if (get_random_float() >= scene.RussianRoulette) break;
+                    beta = beta / scene.RussianRoulette;
+                }
+                ray = offsetRay(p, n, wi);
+            }
+        }
+    });
+}
+
+void SPPMIntegrator::gather(int rowBegin, int rowEnd)
+{
+    parallelFor(rowEnd - rowBegin, 0, [&](int row) {
+        int j = rowBegin + row;
+        for (int i = 0; i < camera.width; ++i) {
+            SPPMPixel &pixel = pixels[j * camera.width + i];
+            if (!pixel.valid) continue;
+            float r = pixel.radius, r2 = r * r;
+            Vector3f Phi(0.f);
+            float M = 0.f;
+            // 不同格子可能哈希到同一个位置，每个位置只访问一次
+            // 格子边长等于最大半径，[p - r, p + r]每轴覆盖3格，浮点舍入时可能覆盖4格
+            uint32_t visited[64];
+            int visitedNum = 0;
+            int x0 = grid.cell(pixel.p.x - r), x1 = grid.cell(pixel.p.x + r);
+            int y0 = grid.cell(pixel.p.y - r), y1 = grid.cell(pixel.p.y + r);
+            int z0 = grid.cell(pixel.p.z - r), z1 = grid.cell(pixel.p.z + r);
+            for (int x = x0; x <= x1; ++x)
+                for (int y = y0; y <= y1; ++y)
+                    for (int z = z0; z <= z1; ++z) {
+                        uint32_t h = grid.hash(x, y, z);
+                        if (std::find(visited, visited + visitedNum, h) != visited + visitedNum) continue;
+                        visited[visitedNum++] = h;
+                        for (uint32_t k = grid.cellStart[h]; k < grid.cellStart[h + 1]; ++k) {
+                            const Photon &photon = grid.photons[k];
+                            Vector3f d = photon.p - pixel.p;
+                            if (dotProduct(d, d) > r2) continue;
+                            Phi += evalMaterial(scene.materials, pixel.m, photon.wi, pixel.wo, pixel.n, pixel.tcoords) * photon.flux;
+                            M += 1.f;
+                        }
+                    }
+            if (M == 0.f) continue;
+            // 新光子只保留alpha的比例，半径按光子密度不变缩小，已累计的功率随面积缩放
+            float N = pixel.N + alpha * M;
+            float radius = r * std::sqrt(N / (pixel.N + M));
+            pixel.tau = (pixel.tau + pixel.beta * Phi) * (radius * radius / r2);
+            pixel.N = N;
+            pixel.radius = radius;
+        }
+    });
+}
+
+void SPPMIntegrator::iterate(Film &film, int rowBegin, int rowEnd, uint64_t seed)
+{
+    if (pixels.empty()) {
+        pixels.resize(camera.width * camera.height);
+        float radius = initialRadius > 0.f ? initialRadius : 0.01f * scene.sceneRadius;
+        for (auto &pixel : pixels) pixel.radius = radius;
+    }
+    int photonNum = photonsPerIteration > 0 ? photonsPerIteration : camera.width * camera.height;
+    ++iterations;
+
+    generateVisiblePoints(rowBegin, rowEnd, hash_combine(seed, 0));
+    tracePhotons(photonNum, hash_combine(seed, 1));
+    float maxRadius = 0.f;
+    for (int index = rowBegin * camera.width; index < rowEnd * camera.width; ++index)
+        if (pixels[index].valid) maxRadius = std::max(maxRadius, pixels[index].radius);
+    grid.build(photonChunks, maxRadius > 0.f ? maxRadius : 1.f);
+    gather(rowBegin, rowEnd);
+
+    // 间接光照 = tau / (发射的光子总数 * pi * r^2)，film中的累加和按采样数（轮数）平均
+    for (int index = rowBegin * camera.width; index < rowEnd * camera.width; ++index) {
+        const SPPMPixel &pixel = pixels[index];
+        float area = M_PI * pixel.radius * pixel.radius;
+        film.radiance[index] = pixel.Ld + pixel.tau / (photonNum * area);
+        film.sampleCount[index] = iterations;
+    }
+}
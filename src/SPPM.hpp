@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "Scene.hpp"
+#include "Camera.hpp"
+#include "Film.hpp"
+
+// 光子：位置、到达方向（朝外，指向光子来的方向）和功率
+struct Photon
+{
+    Vector3f p;
+    Vector3f wi;
+    Vector3f flux;
+};
+
+// 光子的哈希网格：格子边长不小于收集半径，一个点的收集范围最多覆盖每个方向上相邻的3个格子
+// 按格子哈希做计数排序，同一个格子的光子在photons中连续存放，收集时顺序读取
+struct PhotonGrid
+{
+    float cellSize = 1.f;
+    std::vector<Photon> photons; // 按哈希排序后的光子
+    std::vector<uint32_t> cellStart; // 哈希值为h的光子在photons中的范围是[cellStart[h], cellStart[h + 1])
+    uint32_t mask = 0; // 哈希表大小 - 1（大小为2的幂）
+
+    uint32_t hash(int x, int y, int z) const
+    {
+        return ((uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u) & mask;
+    }
+    int cell(float v) const { return (int)std::floor(v / cellSize); }
+
+    // 由各块发射的光子构建网格，cellSize为最大的收集半径
+    void build(const std::vector<std::vector<Photon> > &chunks, float cellSize);
+};
+
+// 像素的统计量和这一轮的可见点（相机路径经过镜面反射/折射后遇到的第一个非镜面着色点）
+struct SPPMPixel
+{
+    Vector3f Ld; // 各轮直接光照（以及直接看到光源）之和
+    float radius = 0.f; // 当前的收集半径
+    float N = 0.f; // 累计的有效光子数
+    Vector3f tau; // 累计的（已按半径缩放的）光子功率
+
+    // 可见点
+    bool valid = false;
+    Vector3f p, n, wo, beta;
+    Material *m = nullptr;
+    Vector2f tcoords;
+};
+
+// 随机渐进式光子映射（Stochastic Progressive Photon Mapping），refer: Hachisuka & Jensen 2009, pbrt-v3
+// 每一轮：从相机出发，穿过镜面反射/折射找到每个像素的可见点，并用光源采样计算可见点的直接光照；
+// 然后从光源并行发射光子，经过至少一次反射后落在非镜面上的光子存入哈希网格；
+// 最后每个可见点收集半径内的光子，按alpha缩小半径（半径内光子数N的增长只保留alpha的比例）
+// 焦散（光源 -> 镜面 -> 漫反射 -> 镜面 -> 相机）由光子负责，不再只能由路径追踪偶然得到的高亮噪点估计
+// 镜面材质（Mirror）和透明材质（Transparent）按镜面处理，光源只向法线一侧发光，击中光源后路径结束
+class SPPMIntegrator
+{
+public:
+    SPPMIntegrator(const Scene &scene, const Camera &camera, int thread_num);
+
+    int photonsPerIteration = 0; // 每一轮发射的光子数，0表示与像素数相同
+    float initialRadius = 0.f; // 初始收集半径，0表示场景包围球半径的1%
+    float alpha = 2.f / 3.f; // 每一轮保留的新光子比例，决定半径缩小的速度
+    int maxDepth = 16; // 相机路径和光子路径的最大弹射次数
+
+    // 对行[rowBegin, rowEnd)进行一轮，film中这些像素的radiance和采样数改为当前的估计
+    void iterate(Film &film, int rowBegin, int rowEnd, uint64_t seed);
+
+private:
+    const Scene &scene;
+    const Camera &camera;
+    int thread_num;
+    std::vector<SPPMPixel> pixels;
+    int iterations = 0;
+    PhotonGrid grid;
+    std::vector<std::vector<Photon> > photonChunks; // 每块光子的发射结果，块的随机序列只与种子和块号有关
+
+    // 多线程依次领取[0, count)中的任务，任务i的随机序列由stageSeed和i决定，结果与线程数无关
+    template<typename Task>
+    void parallelFor(int count, uint64_t stageSeed, const Task &task);
+
+    void generateVisiblePoints(int rowBegin, int rowEnd, uint64_t seed);
+    void tracePhotons(int count, uint64_t seed);
+    void gather(int rowBegin, int rowEnd);
+
+    // 在镜面材质（Mirror/Transparent）上采样下一个方向，beta乘上对应的系数；不是镜面时返回false
+    bool sampleSpecular(const Intersection &inter, const Vector3f &wo, Vector3f &wi, Vector3f &beta) const;
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include "Vector.hpp"
+#include "global.hpp"
+
+// 按立体角采样面光源用到的函数，refer: pbrt-v4
+// 立体角过小时数值不稳定、过大时（参考点贴近光源）收益不大，此时光源退回按面积采样
+const float MIN_SPHERICAL_SAMPLE_AREA = 3e-4f;
+const float MAX_SPHERICAL_SAMPLE_AREA = 6.22f;
+
+inline float safeSqrt(float x) { return std::sqrt(std::max(0.f, x)); }
+
+inline float safeAcos(float x) { return std::acos(clamp(-1.f, 1.f, x)); }
+
+// 单位向量v1, v2的夹角，夹角接近0或pi时比acos(dot)更精确
+inline float angleBetween(const Vector3f &v1, const Vector3f &v2)
+{
+    if (dotProduct(v1, v2) < 0)
+        return M_PI - 2 * std::asin(std::min(1.f, (v1 + v2).norm() / 2));
+    return 2 * std::asin(std::min(1.f, (v2 - v1).norm() / 2));
+}
+
+// 去掉v中与单位向量w平行的分量
+inline Vector3f gramSchmidt(const Vector3f &v, const Vector3f &w) { return v - dotProduct(v, w) * w; }
+
+// 三角形v0v1v2从p看去所张的立体角（球面三角形面积）
+inline float sphericalTriangleArea(const Vector3f &v0, const Vector3f &v1, const Vector3f &v2, const Vector3f &p)
+{
+    Vector3f a = normalize(v0 - p), b = normalize(v1 - p), c = normalize(v2 - p);
+    return std::fabs(2 * std::atan2(dotProduct(a, crossProduct(b, c)),
+                                    1 + dotProduct(a, b) + dotProduct(a, c) + dotProduct(b, c)));
+}
+
+// 在三角形v0v1v2从p看去的球面三角形上均匀采样一个方向（Arvo 1995），失败时返回false
+inline bool sampleSphericalTriangle(const Vector3f &v0, const Vector3f &v1, const Vector3f &v2, const Vector3f &p,
+                                    float u0, float u1, Vector3f &w)
+{
+    Vector3f a = normalize(v0 - p), b = normalize(v1 - p), c = normalize(v2 - p);
+    Vector3f n_ab = crossProduct(a, b), n_bc = crossProduct(b, c), n_ca = crossProduct(c, a);
+    if (dotProduct(n_ab, n_ab) == 0 || dotProduct(n_bc, n_bc) == 0 || dotProduct(n_ca, n_ca) == 0) return false;
+    n_ab = normalize(n_ab); n_bc = normalize(n_bc); n_ca = normalize(n_ca);
+
+    // 球面三角形的三个内角
+    float alpha = angleBetween(n_ab, -n_ca);
+    float beta = angleBetween(n_bc, -n_ab);
+    float gamma = angleBetween(n_ca, -n_bc);
+
+    // 按u0选出子三角形的面积A'，求出新顶点c'
+    float A_pi = alpha + beta + gamma;
+    float Ap_pi = M_PI + u0 * (A_pi - M_PI);
+    if (A_pi - M_PI <= 0) return false;
+    float cosAlpha = std::cos(alpha), sinAlpha = std::sin(alpha);
+    float sinPhi = std::sin(Ap_pi) * cosAlpha - std::cos(Ap_pi) * sinAlpha;
+    float cosPhi = std::cos(Ap_pi) * cosAlpha + std::sin(Ap_pi) * sinAlpha;
+    float k1 = cosPhi + cosAlpha;
+    float k2 = sinPhi - sinAlpha * dotProduct(a, b);
+    float cosBp = (k2 + (k2 * cosPhi - k1 * sinPhi) * cosAlpha) / ((k2 * sinPhi + k1 * cosPhi) * sinAlpha);
+    cosBp = clamp(-1.f, 1.f, cosBp);
+    float sinBp = safeSqrt(1 - cosBp * cosBp);
+    Vector3f cp = cosBp * a + sinBp * normalize(gramSchmidt(c, a));
+
+    // 在b和c'之间的弧上按u1采样
+    float cosTheta = 1 - u1 * (1 - dotProduct(cp, b));
+    float sinTheta = safeSqrt(1 - cosTheta * cosTheta);
+    w = normalize(cosTheta * b + sinTheta * normalize(gramSchmidt(cp, b)));
+    return true;
+}
+
+// 矩形光源：角点s，两条互相垂直的边ex, ey
+// 从p看去矩形所张的立体角，同时给出采样需要的局部坐标；立体角不大于0时返回0
+struct SphericalRectangle
+{
+    Vector3f x, y, z; // 局部坐标系，z指向矩形背离p的一侧
+    float x0, y0, x1, y1, z0; // 矩形在局部坐标系中的范围，z0 < 0
+    float b0, b1, k, area;
+
+    SphericalRectangle(const Vector3f &s, const Vector3f &ex, const Vector3f &ey, const Vector3f &p)
+    {
+        float exl = std::sqrt(dotProduct(ex, ex)), eyl = std::sqrt(dotProduct(ey, ey));
+        x = ex / exl; y = ey / eyl; z = crossProduct(x, y);
+        Vector3f d = s - p;
+        x0 = dotProduct(d, x); y0 = dotProduct(d, y); z0 = dotProduct(d, z);
+        if (z0 > 0) { z0 = -z0; z = -z; }
+        x1 = x0 + exl; y1 = y0 + eyl;
+
+        Vector3f v00(x0, y0, z0), v01(x0, y1, z0), v10(x1, y0, z0), v11(x1, y1, z0);
+        Vector3f n0 = normalize(crossProduct(v00, v10)), n1 = normalize(crossProduct(v10, v11));
+        Vector3f n2 = normalize(crossProduct(v11, v01)), n3 = normalize(crossProduct(v01, v00));
+        float g0 = angleBetween(-n0, n1), g1 = angleBetween(-n1, n2);
+        float g2 = angleBetween(-n2, n3), g3 = angleBetween(-n3, n0);
+        b0 = n0.z; b1 = n2.z;
+        k = 2 * M_PI - g2 - g3;
+        area = z0 < 0 ? g0 + g1 - k : 0.f;
+    }
+
+    // 在球面矩形上均匀采样，返回矩形上的点（Ureña et al. 2013）
+    Vector3f sample(const Vector3f &p, float u0, float u1) const
+    {
+        float au = u0 * area + k;
+        float fu = (std::cos(au) * b0 - b1) / std::sin(au);
+        float cu = std::copysign(1 / std::sqrt(fu * fu + b0 * b0), fu);
+        cu = clamp(-1.f, 1.f, cu);
+        float xu = -(cu * z0) / safeSqrt(1 - cu * cu);
+        xu = clamp(x0, x1, xu);
+
+        float dd = std::sqrt(xu * xu + z0 * z0);
+        float h0 = y0 / std::sqrt(dd * dd + y0 * y0);
+        float h1 = y1 / std::sqrt(dd * dd + y1 * y1);
+        float hv = h0 + u1 * (h1 - h0), hvsq = hv * hv;
+        float yv = hvsq < 1 - 1e-6f ? (hv * dd) / std::sqrt(1 - hvsq) : y1;
+        return p + xu * x + yv * y + z0 * z;
+    }
+};
+
+// 一维分段常数分布：[0, 1]等分为n段，第i段的密度正比于func[i]
+// 与AliasTable不同，采样是对CDF二分查找求逆，得到的是连续值，相邻的u映射到相邻的位置
+struct PiecewiseConstant1D
+{
+    std::vector<float> func, cdf; // cdf有n + 1项，cdf[0] = 0, cdf[n] = 1
+    float funcInt = 0.f; // func在[0, 1]上的积分
+
+    PiecewiseConstant1D() = default;
+    explicit PiecewiseConstant1D(const float *f, int n) : func(f, f + n), cdf(n + 1)
+    {
+        for (auto &v : func) v = std::fabs(v);
+        cdf[0] = 0.f;
+        for (int i = 1; i <= n; ++i) cdf[i] = cdf[i - 1] + func[i - 1] / n;
+        funcInt = cdf[n];
+        // 全为0时退化为均匀分布
+        if (funcInt == 0.f) for (int i = 1; i <= n; ++i) cdf[i] = float(i) / n;
+        else for (int i = 1; i <= n; ++i) cdf[i] /= funcInt;
+    }
+
+    int size() const { return func.size(); }
+
+    // u为[0, 1)的随机数，返回[0, 1)中的采样值，pdf为该处的密度，offset为所在的段
+    float sample(float u, float &pdf, int &offset) const
+    {
+        // 最后一个cdf[i] <= u的i
+        offset = std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin() - 1;
+        offset = std::max(0, std::min(size() - 1, offset));
+        float du = u - cdf[offset];
+        if (cdf[offset + 1] - cdf[offset] > 0.f) du /= cdf[offset + 1] - cdf[offset];
+        pdf = funcInt > 0.f ? func[offset] / funcInt : 1.f;
+        return std::min((offset + du) / size(), 1.f - std::numeric_limits<float>::epsilon());
+    }
+};
+
+// 二维分段常数分布：先按每行的积分（边缘分布）选行v，再在该行内（条件分布）选列u
+// pdf(u, v) = func(u, v) / 整个定义域上的积分
+struct PiecewiseConstant2D
+{
+    std::vector<PiecewiseConstant1D> conditional; // 每行一个
+    PiecewiseConstant1D marginal;
+
+    PiecewiseConstant2D() = default;
+    // func按行存放，nu列nv行
+    PiecewiseConstant2D(const float *func, int nu, int nv)
+    {
+        conditional.reserve(nv);
+        for (int v = 0; v < nv; ++v) conditional.emplace_back(func + v * nu, nu);
+        std::vector<float> rowInt(nv);
+        for (int v = 0; v < nv; ++v) rowInt[v] = conditional[v].funcInt;
+        marginal = PiecewiseConstant1D(rowInt.data(), nv);
+    }
+
+    bool empty() const { return conditional.empty(); }
+    float integral() const { return marginal.funcInt; }
+
+    // 返回[0, 1)^2中的采样点，pdf为该处的密度
+    Vector2f sample(float u0, float u1, float &pdf) const
+    {
+        float pdfs[2];
+        int v;
+        float d1 = marginal.sample(u1, pdfs[1], v);
+        int u;
+        float d0 = conditional[v].sample(u0, pdfs[0], u);
+        pdf = pdfs[0] * pdfs[1];
+        return Vector2f(d0, d1);
+    }
+
+    float pdf(const Vector2f &p) const
+    {
+        int nu = conditional[0].size(), nv = marginal.size();
+        int iu = std::min(nu - 1, std::max(0, int(p.x * nu))), iv = std::min(nv - 1, std::max(0, int(p.y * nv)));
+        if (marginal.funcInt == 0.f) return 1.f;
+        return conditional[iv].func[iu] / marginal.funcInt;
+    }
+};
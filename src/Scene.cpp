@@ -1,9 +1,96 @@
 #include "Scene.hpp"
+#include "ShadingBatch.hpp" // castRayPT使用非虚函数的材质分派
 
 
 void Scene::buildBVH() {
     printf(" - Generating BVH...\n\n");
     this->bvh = new BVHAccel(objects, 1, BVHAccel::SplitMethod::NAIVE);
+
+    // 场景中所有物体及其图元的材质重新编入材质表
+    materials.clear();
+    for (auto object : objects) {
+        std::vector<Object*> primitives;
+        object->getPrimitives(primitives);
+        primitives.push_back(object);
+        for (auto primitive : primitives) materials.add(primitive->getMaterial());
+    }
+    materials.build();
+
+    emitters.clear();
+    emitterIndex.clear();
+    std::vector<float> power;
+    for (auto object : objects) {
+        if (!object->hasEmit()) continue;
+        std::vector<Object*> primitives;
+        object->getPrimitives(primitives);
+        for (auto primitive : primitives) emitterIndex[primitive] = emitters.size();
+        emitterIndex[object] = emitters.size();
+        emitters.push_back(object);
+        power.push_back(luminance(object->getMaterial()->getEmission()) * object->getArea());
+    }
+
+    Bounds3 bounds = bvh->root ? bvh->root->bounds : Bounds3();
+    sceneCenter = bounds.Centroid();
+    sceneRadius = bvh->root ? bounds.Diagonal().norm() / 2 : 0.f;
+    if (environment) power.push_back(environment->power(sceneRadius));
+    lightDistribution.build(power);
+    environmentPmf = environment && !lightDistribution.empty() ? lightDistribution.pmf(emitters.size()) : 0.f;
+
+    if (usePathGuiding) guiding = std::make_unique<GuidingField>(bounds);
+    if (radianceCachePasses > 0) {
+        radianceCache = std::make_unique<RadianceCache>(radianceCacheCellSize > 0.f ? radianceCacheCellSize : 0.02f * sceneRadius);
+        radianceCache->maxError = radianceCacheError;
+    }
+
+    if (useLightBVH) {
+        std::vector<Object*> primitives;
+        for (auto object : emitters) object->getPrimitives(primitives);
+        lightBVH = new LightBVH(primitives);
+        // 光源BVH的重要度与环境光的功率不可比，有其他光源时各取一半
+        if (environment) environmentPmf = lightBVH->empty() ? 1.f : 0.5f;
+    }
+}
+
+uint64_t Scene::hash() const
+{
+    uint64_t h = hash_bytes(&width, sizeof(width));
+    h = hash_bytes(&height, sizeof(height), h);
+    h = hash_bytes(&fov, sizeof(fov), h);
+    h = hash_bytes(&backgroundColor, sizeof(backgroundColor), h);
+    h = hash_bytes(&RussianRoulette, sizeof(RussianRoulette), h);
+    if (environment) {
+        float envPower = environment->power(1.f);
+        h = hash_bytes(&environment->width, sizeof(environment->width), h);
+        h = hash_bytes(&environment->height, sizeof(environment->height), h);
+        h = hash_bytes(&envPower, sizeof(envPower), h);
+    }
+    // 介质（类型、系数、范围、相函数）及体积直接光照的采样方式
+    size_t mediumCount = media.size();
+    h = hash_bytes(&mediumCount, sizeof(mediumCount), h);
+    for (auto &medium : media) h = medium->hash(h);
+    h = hash_bytes(&equiangularSampling, sizeof(equiangularSampling), h);
+    for (auto object : objects) {
+        Bounds3 bounds = object->getBounds();
+        float area = object->getArea();
+        bool emit = object->hasEmit();
+        h = hash_bytes(&bounds, sizeof(bounds), h);
+        h = hash_bytes(&area, sizeof(area), h);
+        h = hash_bytes(&emit, sizeof(emit), h);
+        // 材质参数（发光强度、颜色等）改变时图像也会改变
+        Material *m = object->getMaterial();
+        if (!m) continue;
+        MaterialType type = m->getType();
+        Vector3f emission = m->getEmission();
+        h = hash_bytes(&type, sizeof(type), h);
+        h = hash_bytes(&emission, sizeof(emission), h);
+        h = hash_bytes(&m->Kd, sizeof(m->Kd), h);
+        h = hash_bytes(&m->Ks, sizeof(m->Ks), h);
+        h = hash_bytes(&m->roughness, sizeof(m->roughness), h);
+        h = hash_bytes(&m->ior, sizeof(m->ior), h);
+        h = hash_bytes(&m->specularExponent, sizeof(m->specularExponent), h);
+        if (m->texture_color) h = m->texture_color->hash(h);
+    }
+    return h;
 }
 
 Intersection Scene::intersect(const Ray &ray) const
@@ -11,26 +98,92 @@ Intersection Scene::intersect(const Ray &ray) const
     return this->bvh->Intersect(ray);
 }
 
-// 在所有自发光物体上随机选一个物体，然后在该物体上随机选一个点
-void Scene::sampleLight(Intersection &pos, float &pdf) const
+// 用别名表按功率选一个发光物体（O(1)），然后从着色点看去在该物体上采样一个点
+// 开启光源BVH时，按对着色点贡献的估计选一个发光图元，然后在图元上采样一个点
+void Scene::sampleLight(const Vector3f &p, const Vector3f &n, Intersection &pos, float &pdf) const
 {
-    float emit_area_sum = 0;
-    for (uint32_t k = 0; k < objects.size(); ++k) {
-        if (objects[k]->hasEmit()){
-            emit_area_sum += objects[k]->getArea();
+    pdf = 0.f;
+    float pmf;
+    bool sampleEnvironment = false;
+    if (lightBVH) {
+        float u = get_random_float();
+        if (u < environmentPmf) {
+            sampleEnvironment = true;
+            pmf = environmentPmf;
+        } else {
+            u = std::min((u - environmentPmf) / (1 - environmentPmf), 1.f - std::numeric_limits<float>::epsilon());
+            Object *light = lightBVH->Sample(p, n, u, pmf);
+            if (!light) return;
+            light->Sample(p, pos, pdf);
+            pmf *= 1 - environmentPmf;
         }
+    } else {
+        if (lightDistribution.empty()) return;
+        int k = lightDistribution.sample(get_random_float(), pmf);
+        if (k == (int)emitters.size()) sampleEnvironment = true;
+        else emitters[k]->Sample(p, pos, pdf);
     }
-    float p = get_random_float() * emit_area_sum;
-    emit_area_sum = 0;
-    for (uint32_t k = 0; k < objects.size(); ++k) {
-        if (objects[k]->hasEmit()){
-            emit_area_sum += objects[k]->getArea();
-            if (p <= emit_area_sum){
-                objects[k]->Sample(pos, pdf);
-                break;
-            }
-        }
+
+    if (sampleEnvironment) {
+        Vector3f wi;
+        float dirPdf;
+        Vector3f Le = environment->Sample(get_random_float(), get_random_float(), wi, dirPdf);
+        if (dirPdf <= 0.f) return;
+        float dis = (p - sceneCenter).norm() + 2 * sceneRadius + 1.f; // 保证在场景包围球外
+        pos.coords = p + wi * dis;
+        pos.normal = -wi;
+        pos.emit = Le;
+        pos.obj = nullptr;
+        pdf = dirPdf / (dis * dis); // 法线正对p，cos = 1
+    }
+    pdf *= pmf; // 乘上选中该物体的概率
+}
+
+float Scene::pdfLight(const Vector3f &p, const Vector3f &n, const Intersection &lightPoint) const
+{
+    if (lightPoint.obj == nullptr) return 0.f;
+    if (lightBVH) return (1 - environmentPmf) * lightBVH->PMF(p, n, lightPoint.obj) * lightPoint.obj->Pdf(p, lightPoint);
+    auto it = emitterIndex.find(lightPoint.obj);
+    if (it == emitterIndex.end()) return 0.f;
+    return lightDistribution.pmf(it->second) * emitters[it->second]->Pdf(p, lightPoint);
+}
+
+float Scene::pdfEnvironment(const Vector3f &w) const
+{
+    if (!environment) return 0.f;
+    return environmentPmf * environment->Pdf(w);
+}
+
+Vector3f Scene::unshadowedLight(const Vector3f &p, const Vector3f &n, const Vector3f &wo, Material *m,
+                                const Vector2f &tcoords, const Intersection &lightPoint, PhaseFunction *pf) const
+{
+    Vector3f d = lightPoint.coords - p;
+    float dis2 = dotProduct(d, d);
+    if (dis2 <= 0.f) return Vector3f(0.f);
+    Vector3f ws = d / std::sqrt(dis2);
+    float costheta_prime = dotProduct(-ws, lightPoint.normal);
+    if (costheta_prime <= 0.f) return Vector3f(0.f);
+    if (!m) return lightPoint.emit * (pf ? pf : phase.get())->eval(ws, wo) * costheta_prime / dis2;
+    float costheta = dotProduct(ws, n);
+    if (costheta <= 0.f) return Vector3f(0.f);
+    return lightPoint.emit * evalMaterial(materials, m, ws, wo, n, tcoords) * costheta * costheta_prime / dis2;
+}
+
+// 候选按sampleLight的pdf生成，权重为目标函数 / pdf，选中的样本近似按未遮挡的贡献分布
+// 候选只需要计算brdf，不追踪阴影光线，候选数越多越接近按贡献采样
+void Scene::sampleLightRIS(const Vector3f &p, const Vector3f &n, const Vector3f &wo, Material *m,
+                           const Vector2f &tcoords, Reservoir &r, PhaseFunction *pf) const
+{
+    Vector3f n_ref = m ? n : Vector3f(0.f);
+    for (int k = 0; k < risCandidates; ++k) {
+        Intersection lightPoint;
+        float pdf = 0.f;
+        sampleLight(p, n_ref, lightPoint, pdf);
+        float pHat = pdf > 0.f ? luminance(unshadowedLight(p, n, wo, m, tcoords, lightPoint, pf)) : 0.f;
+        if (pdf > 0.f) r.update(lightPoint, pHat / pdf, pHat, get_random_float());
+        else r.M += 1.f;
     }
+    r.finalize();
 }
 
 // 光线与场景中所有物体求交（被bvh取代）
@@ -54,26 +207,78 @@ void Scene::sampleLight(Intersection &pos, float &pdf) const
 // }
 
 // Implementation of Path Tracing
-Vector3f Scene::castRayPT(const Ray &ray) const
+// 等角采样：光线上到点y所张的角度在[a, b]上均匀分布，delta为y在光线上的投影，D为y到光线的距离
+static bool equiangularSetup(const Ray &ray, float a, float b, const Vector3f &y, float &delta, float &D, float &thetaA, float &thetaB)
+{
+    delta = dotProduct(y - ray.origin, ray.direction);
+    Vector3f perp = y - ray(delta);
+    D = std::sqrt(dotProduct(perp, perp));
+    if (D < EPSILON) return false; // y在光线上
+    thetaA = std::atan2(a - delta, D);
+    thetaB = std::atan2(b - delta, D);
+    return thetaB > thetaA;
+}
+
+// 等角采样到距离t的概率密度D / ((thetaB - thetaA) * (D^2 + (t - delta)^2))
+static float equiangularDistancePdf(const Ray &ray, float a, float b, const Vector3f &y, float t)
+{
+    float delta, D, thetaA, thetaB;
+    if (t < a || t > b || !equiangularSetup(ray, a, b, y, delta, D, thetaA, thetaB)) return 0.f;
+    float h = t - delta;
+    return D / ((thetaB - thetaA) * (D * D + h * h));
+}
+
+Vector3f Scene::castRayPT(const Ray &ray, AOVSample *aov) const
+{
+    return castRayPT(ray, Scene::intersect(ray), aov);
+}
+
+Vector3f Scene::castRayPT(const Ray &ray, const Intersection &hit, AOVSample *aov) const
 {
     //Path Tracing Algorithm
-    Intersection inter = Scene::intersect(ray);
+    Intersection inter = hit;
 
     /* volumetric */
-    float dis = medium->sample(ray);
-    bool hitMedium = dis < inter.distance;
-    //inter.distance -= 200.f;
-    //std::cout << dis << std::endl;
-    //hitMedium = dis < 3.f;
-    hitMedium = false; // 关闭体积光
+    // 在光线与表面交点之前的介质中采样散射点，mediumWeight为对距离采样的系数，pf为散射点所在介质的相函数
+    float dis = 0.f, mediumWeight = 1.f;
+    float tMax = inter.happened ? (float)inter.distance : kInfinity;
+    Medium *scatterMedium = nullptr;
+    if(!media.empty()) dis = sampleMedium(ray, tMax, mediumWeight, scatterMedium);
+    bool hitMedium = scatterMedium != nullptr;
+    PhaseFunction *pf = hitMedium ? scatterMedium->pf : nullptr;
+    // 等角采样估计的这段光线上的单次散射直接光照，不乘距离采样的系数
+    float eqA = 0.f, eqB = 0.f, distancePdf = 0.f, albedo;
+    bool equiangular = !media.empty() && equiangularRange(ray, tMax, eqA, eqB);
+    Vector3f L_eq = equiangular ? equiangularScattering(ray, eqA, eqB) : Vector3f(0.f);
+    if(equiangular && hitMedium) distancePdf = scatterMedium->pdf(ray, dis, albedo);
+    // 散射点处光源点y被等角采样到的pdf（立体角度量，除以距离采样的pdf），用于散射点处三种策略的MIS
+    auto equiangularPdf = [&](const Intersection &y, float dist2, float cosLight){
+        if(!equiangular || !hitMedium || !y.obj || cosLight <= 0.f || distancePdf <= 0.f) return 0.f;
+        float eqDistancePdf = equiangularDistancePdf(ray, eqA, eqB, y.coords, dis);
+        return eqDistancePdf / distancePdf * pdfLight(ray.origin, Vector3f(0.f), y) * dist2 / cosLight;
+    };
     /* volumetric */
     
-    if(!inter.happened) return this->backgroundColor; // 背景色
+    if(!inter.happened && !hitMedium){
+        if(aov) aov->direct = background(ray.direction) + L_eq;
+        return background(ray.direction) + L_eq; // 背景色 / 环境光
+    }
+    if(aov && inter.happened){
+        aov->hit = true;
+        aov->albedo = inter.m->getColorAt(inter.tcoords.x, inter.tcoords.y);
+        aov->normal = normalize(inter.normal);
+        aov->depth = inter.distance;
+        aov->m = inter.m;
+        aov->obj = inter.obj;
+    }
 
     /* volumetric */
     if(!hitMedium){
         // 光线直接打到光源/光线最终到达光源
-        if(inter.m->hasEmission()) return inter.m->getEmission();
+        if(inter.m->hasEmission()){
+            if(aov) aov->direct = inter.m->getEmission() + L_eq;
+            return inter.m->getEmission() + L_eq;
+        }
     }
     //if(inter.m->hasEmission()) return inter.m->getEmission();
 
@@ -92,10 +297,11 @@ Vector3f Scene::castRayPT(const Ray &ray) const
     Vector3f L_dir = 0.f;
 
     auto compute_direct = [&]{
-        // 对光源均匀采样
+        // 对光源采样（光源BVH以着色点和法线估计各光源的贡献，介质中的散射点不考虑法线）
+        Vector3f n_ref = hitMedium ? Vector3f(0.f) : n;
         Intersection lightPoint;
         float lightPdf = 0.f;
-        sampleLight(lightPoint, lightPdf);
+        sampleLight(pos, n_ref, lightPoint, lightPdf);
 
         auto light_pos = lightPoint.coords; // 光源位置
         auto light_n = lightPoint.normal.normalized(); // 光源法线
@@ -104,20 +310,35 @@ Vector3f Scene::castRayPT(const Ray &ray) const
         // 多重重要性采样，对brdf或phase function采样
         Vector3f L_dir_frp = 0.f;
         /* volumetric */
-        auto w_mis = hitMedium ? medium->pf->sample(wo, pos).normalized() : inter.m->sample(wo, n).normalized();  // 散射光方向 / 入射光方向
+        auto w_mis = hitMedium ? pf->sample(wo, pos).normalized() : normalize(sampleMaterial(materials, inter.m, wo, n));  // 散射光方向 / 入射光方向
         /* volumetric */
         // 方向是否朝向光源
         Intersection shadow_mis = Scene::intersect(Ray(pos_deviation, w_mis));
         bool mis_IsHitLight = shadow_mis.happened && shadow_mis.m->hasEmission();
-        float frpPdf = hitMedium ? medium->pf->pdf(w_mis, wo) : inter.m->pdf(w_mis, wo, n);
-        if(mis_IsHitLight){
+        float frpPdf = hitMedium ? pf->pdf(w_mis, wo) : pdfMaterial(materials, inter.m, w_mis, wo, n);
+        float lightPdf_frp = 0.f; // 光源采样得到w_mis方向上这一点的立体角pdf
+        float eqPdf_frp = 0.f; // 等角采样得到这一点的pdf
+        Vector3f Li_mis = 0.f;
+        if(mis_IsHitLight && frpPdf > 0.f){
+            auto cos_light = dotProduct(-w_mis, normalize(shadow_mis.normal));
+            if(cos_light > 0.f){
+                lightPdf_frp = pdfLight(pos, n_ref, shadow_mis) * shadow_mis.distance * shadow_mis.distance / cos_light;
+                eqPdf_frp = equiangularPdf(shadow_mis, shadow_mis.distance * shadow_mis.distance, cos_light);
+            }
+            Li_mis = shadow_mis.emit * transmittance(Ray(pos_deviation, w_mis), shadow_mis.distance);
+        }else if(!shadow_mis.happened && environment && frpPdf > 0.f){
+            // 没有击中物体，到达环境光
+            lightPdf_frp = pdfEnvironment(w_mis);
+            Li_mis = environment->Le(w_mis) * transmittance(Ray(pos_deviation, w_mis), kInfinity);
+        }
+        if(frpPdf > 0.f){
             if(!hitMedium){
-                auto fr = inter.m->eval(w_mis, wo, n, inter.tcoords);
+                auto fr = evalMaterial(materials, inter.m, w_mis, wo, n, inter.tcoords);
                 auto costheta = dotProduct(w_mis, n);
-                L_dir_frp = shadow_mis.emit * fr * costheta / frpPdf;
+                L_dir_frp = Li_mis * fr * costheta / frpPdf;
             }else{
-                auto fp = medium->pf->eval(w_mis, wo);
-                L_dir_frp = shadow_mis.emit * fp / frpPdf;
+                auto fp = pf->eval(w_mis, wo);
+                L_dir_frp = Li_mis * fp / frpPdf;
             }
         }
         
@@ -132,44 +353,88 @@ Vector3f Scene::castRayPT(const Ray &ray) const
 
         // 光线一定会打到光源点上，除非被遮挡
         // 这里的判断精度不能太高，否则会出现奇怪的阴影
-        if(shadowInter.happened && fabs(shadowInter.distance - dis_shadeToLight) < 0.01){
-            // 计算直接光照
-            auto Li = lightPoint.emit;
+        // 环境光的采样点在场景之外，没有击中任何物体即可见
+        bool lightVisible = lightPdf > 0.f && costheta_prime > 0.f;
+        bool unoccluded = lightPoint.obj ? shadowInter.happened && fabs(shadowInter.distance - dis_shadeToLight) < 0.01 :
+                                           !shadowInter.happened;
+        if(lightVisible && unoccluded){
+            // 计算直接光照，光源到着色点之间经过介质时乘上透射率
+            auto Li = lightPoint.emit * transmittance(shade_to_light, lightPoint.obj ? (float)shadowInter.distance : kInfinity);
             /* volumetric */
             if(!hitMedium){
-                auto fr = inter.m->eval(ws, wo, n, inter.tcoords);
+                auto fr = evalMaterial(materials, inter.m, ws, wo, n, inter.tcoords);
                 auto costheta = dotProduct(ws, n);
                 L_dir_light = Li * fr * costheta * costheta_prime / (dis_shadeToLight2 * lightPdf);
             }else{
-                auto fp = medium->pf->eval(ws, wo);
+                auto fp = pf->eval(ws, wo);
                 L_dir_light = Li * fp * costheta_prime / (dis_shadeToLight2 * lightPdf);
             }
             /* volumetric */
         }
 
-        float lightPdf_mis = dis_shadeToLight2 * lightPdf / costheta_prime;
-        // beta = 2
-        float omega_frp = frpPdf * frpPdf / (frpPdf * frpPdf + lightPdf_mis * lightPdf_mis);
-        float omega_light = lightPdf_mis * lightPdf_mis / (frpPdf * frpPdf + lightPdf_mis * lightPdf_mis);
+        // beta = 2，两种采样各自用自己方向上两种策略的pdf计算权重
+        float lightPdf_mis = lightVisible ? dis_shadeToLight2 * lightPdf / costheta_prime : 0.f;
+        float frPdf_light = hitMedium ? pf->pdf(ws, wo) : pdfMaterial(materials, inter.m, ws, wo, n);
+        // 介质中的散射点开启等角采样时，等角采样作为第三种策略参与
+        float eqPdf_light = lightVisible ? equiangularPdf(lightPoint, dis_shadeToLight2, costheta_prime) : 0.f;
+        float omega_frp = frpPdf > 0.f ? frpPdf * frpPdf / (frpPdf * frpPdf + lightPdf_frp * lightPdf_frp + eqPdf_frp * eqPdf_frp) : 0.f;
+        float omega_light = lightVisible ?
+            lightPdf_mis * lightPdf_mis / (frPdf_light * frPdf_light + lightPdf_mis * lightPdf_mis + eqPdf_light * eqPdf_light) : 0.f;
+        // 镜面反射的pdf不是真正的立体角pdf，光源采样对它没有贡献，brdf采样的结果直接计入
+        if(!hitMedium && inter.m->getType() == MIRROR) omega_frp = 1.f;
         L_dir = L_dir_frp * omega_frp + L_dir_light * omega_light;
         //L_dir = L_dir_light;
 
         /* volumetric */
-        //L_dir = medium->Tr(dis_shadeToLight) * L_dir; // 这段要不要乘上Tr？似乎不用，因为最后结果乘了coeff
+        // 两种采样的Li都已乘上着色点到光源之间的透射率；最后的coeff只包含相机/上一段光线到着色点之间的距离采样
         /* volumetric */
     };
-    compute_direct();
+
+    // RIS：从多个光源候选中保留一个，只对它追踪阴影光线
+    auto compute_direct_ris = [&]{
+        Reservoir r;
+        Material *m = hitMedium ? nullptr : inter.m;
+        sampleLightRIS(pos, n, wo, m, inter.tcoords, r, pf);
+        if (r.W <= 0.f) return;
+        Vector3f toLight = r.y.coords - pos;
+        float dis = toLight.norm();
+        Intersection shadowInter = Scene::intersect(Ray(pos_deviation, toLight / dis));
+        bool unoccluded = r.y.obj ? shadowInter.happened && fabs(shadowInter.distance - dis) < 0.01 : !shadowInter.happened;
+        if (!unoccluded) return;
+        float Tr = transmittance(Ray(pos_deviation, toLight / dis), r.y.obj ? (float)shadowInter.distance : kInfinity);
+        L_dir = unshadowedLight(pos, n, wo, m, inter.tcoords, r.y, pf) * r.W * Tr;
+    };
+
+    // 镜面反射只能由brdf采样得到直接光照
+    bool useRIS = risCandidates > 0 && (hitMedium || inter.m->getType() != MIRROR);
+    if (useRIS) compute_direct_ris();
+    else compute_direct();
     
     // 间接光照
     Vector3f L_indir = 0.f;
     float ksi = get_random_float();
     //ksi = 1.f; //只算直接光照
     if(ksi < RussianRoulette){
+        // 路径引导：漫反射/微表面着色点所在的空间叶子训练过时，以bsdfSamplingFraction的概率按brdf采样，否则按引导分布采样
+        bool guided = guiding && !hitMedium && (inter.m->getType() == DIFFUSE || inter.m->getType() == MICROFACET);
+        int guidingLeaf = guided ? guiding->lookup(pos) : 0;
+        bool guideSampling = guided && guiding->canSample(guidingLeaf);
         /* volumetric */
-        auto wi = hitMedium ? medium->pf->sample(wo, pos).normalized() : inter.m->sample(wo, n).normalized();  // 散射光方向 / 入射光方向
+        Vector3f wi;
+        if(hitMedium) wi = pf->sample(wo, pos).normalized(); // 散射光方向
+        else if(guideSampling && get_random_float() >= guiding->bsdfSamplingFraction) wi = guiding->sample(guidingLeaf);
+        else wi = normalize(sampleMaterial(materials, inter.m, wo, n)); // 入射光方向
         /* volumetric */
         // auto wi = normalize(input_pos - pos); // 这样计算是错误的，原因:sample得到的就是方向（从着色点出发），不是位置（不是从原点出发）
 
+        // 着色点上采样到wi的pdf（one-sample MIS时为两种分布的混合）
+        auto surfacePdf = [&]{
+            float bsdfPdf = pdfMaterial(materials, inter.m, wi, wo, n);
+            if(!guideSampling) return bsdfPdf;
+            float alpha = guiding->bsdfSamplingFraction;
+            return alpha * bsdfPdf + (1 - alpha) * guiding->pdf(guidingLeaf, wi);
+        };
+
         Ray traceRay(pos_deviation, wi);
         //Ray traceRay(pos, wi);
         Intersection traceInter = Scene::intersect(traceRay);
@@ -177,19 +442,23 @@ Vector3f Scene::castRayPT(const Ray &ray) const
         auto compute_indirect = [&]{
             /* volumetric */
             if(!hitMedium){
-                auto fr = inter.m->eval(wi, wo, n, inter.tcoords);
+                auto fr = evalMaterial(materials, inter.m, wi, wo, n, inter.tcoords);
                 auto costheta = dotProduct(wi, n);
-                auto inputPdf = inter.m->pdf(wi, wo, n);
+                auto inputPdf = surfacePdf();
                 // 入射光在半球内,否则当pdf接近0时，会出现白色噪点
                 // 这是合理的，因为像素收敛是正确的，但采样数不够，根据能量守恒，为了弥补未采样到的点，会出现高亮白色噪点（firefly），本质是采样数不够
                 //if(inputPdf > EPSILON)
                 // 防止除0，而且当pdf等于0时，说明方向超出了半球范围，不应该计算
-                if(inputPdf > 0.f){
-                    L_indir = castRayPT(traceRay) * fr * costheta / (inputPdf * RussianRoulette);
+                // 引导分布可能采样到半球之外，此时brdf为0，不再追踪
+                if(inputPdf > 0.f && (!guided || costheta > 0.f)){
+                    Vector3f Li;
+                    if(!lookupRadianceCache(traceRay, traceInter, Li)) Li = castRayPT(traceRay);
+                    L_indir = Li * fr * costheta / (inputPdf * RussianRoulette);
+                    if(guided) guiding->record(guidingLeaf, wi, luminance(Li) / inputPdf);
                 }
             }else{
-                auto fp = medium->pf->eval(wi, wo);
-                auto inputPdf = medium->pf->pdf(wi, wo);
+                auto fp = pf->eval(wi, wo);
+                auto inputPdf = pf->pdf(wi, wo);
                 //if(inputPdf > EPSILON)
                 L_indir = castRayPT(traceRay) * fp / (inputPdf * RussianRoulette);
             }
@@ -197,11 +466,27 @@ Vector3f Scene::castRayPT(const Ray &ray) const
         };
 
         if(!traceInter.happened) 
-            L_indir = backgroundColor; // 如果没有交点，意味着色点没有收到间接光照(是0还是背景色？)
+            L_indir = environment ? Vector3f(0.f) : backgroundColor; // 如果没有交点，意味着色点没有收到间接光照(是0还是背景色？)
+            // 环境光已经在直接光照中（光源采样和brdf采样的MIS）计入，这里不再重复
             // L_indir = 0.f;
         else if(!traceInter.m->hasEmission()){
                 compute_indirect();
             }
+        else if(useRIS){
+            // RIS不做brdf采样的MIS，光源采样得不到的点（如光源背面）只能由这条光线计入，权重为1
+            float cos_light = dotProduct(-wi, normalize(traceInter.normal));
+            Vector3f n_ref = hitMedium ? Vector3f(0.f) : n;
+            if(cos_light <= 0.f || pdfLight(pos, n_ref, traceInter) == 0.f){
+                auto Le = traceInter.emit;
+                if(!hitMedium){
+                    auto inputPdf = surfacePdf();
+                    if(inputPdf > 0.f)
+                        L_indir = Le * evalMaterial(materials, inter.m, wi, wo, n, inter.tcoords) * dotProduct(wi, n) / (inputPdf * RussianRoulette);
+                }else{
+                    L_indir = Le * pf->eval(wi, wo) / (pf->pdf(wi, wo) * RussianRoulette);
+                }
+            }
+        }
     }
 
     //return L_dir + L_indir;
@@ -209,15 +494,108 @@ Vector3f Scene::castRayPT(const Ray &ray) const
     /* volumetric */
     // 乘上对距离采样的系数
     //if(hitMedium){L_indir += Vector3f(1.0f, 0.78f, 0.78f);}
-    float coeff = hitMedium ? medium->coefficient(dis, inter.distance) : 1.f;
-    return coeff * (L_dir + L_indir);
+    float coeff = mediumWeight;
+    Vector3f L = coeff * (L_dir + L_indir) + L_eq;
+    if(aov){
+        aov->direct = coeff * L_dir + L_eq;
+        aov->indirect = coeff * L_indir;
+    }
+    // 缓存着色点表面的出射radiance，不含入射光线上的距离采样系数和等角采样的散射
+    if(radianceCache && radianceCache->filling && !hitMedium && inter.m->getType() == DIFFUSE && dotProduct(wo, n) > 0.f)
+        radianceCache->insert(pos, n, L_dir + L_indir);
+    return L;
     /* volumetric */
 }
 
+float Scene::transmittance(const Ray &ray, float distance) const
+{
+    float T = 1.f;
+    for (auto &m : media) {
+        float t0, t1;
+        if (T <= 0.f) break;
+        if (m->intersect(ray, distance, t0, t1)) T *= m->Tr(ray, distance);
+    }
+    return T;
+}
+
+bool Scene::equiangularRange(const Ray &ray, float tMax, float &a, float &b) const
+{
+    if (!equiangularSampling || risCandidates > 0 || media.size() != 1) return false;
+    if (!media[0]->intersect(ray, tMax, a, b)) return false;
+    float albedo;
+    return media[0]->pdf(ray, a, albedo) >= 0.f; // 距离pdf不能解析计算时无法做MIS
+}
+
+Vector3f Scene::equiangularScattering(const Ray &ray, float a, float b) const
+{
+    Medium *medium = media[0].get();
+    // 从光线起点采样光源上一点；环境光在无穷远处，不做等角采样
+    Intersection lightPoint;
+    float lightPdf = 0.f;
+    sampleLight(ray.origin, Vector3f(0.f), lightPoint, lightPdf);
+    if (lightPdf <= 0.f || !lightPoint.obj) return Vector3f(0.f);
+    float delta, D, thetaA, thetaB;
+    if (!equiangularSetup(ray, a, b, lightPoint.coords, delta, D, thetaA, thetaB)) return Vector3f(0.f);
+    float t = delta + D * std::tan(thetaA + get_random_float() * (thetaB - thetaA));
+    if (t < a || t > b) return Vector3f(0.f);
+    float h = t - delta;
+    float eqPdf = D / ((thetaB - thetaA) * (D * D + h * h));
+    // sigma_s(t) * Tr(0, t) = 反照率 * 距离采样的pdf，t在介质外时为0
+    float albedo;
+    float distancePdf = medium->pdf(ray, t, albedo);
+    if (distancePdf <= 0.f) return Vector3f(0.f);
+
+    Vector3f x = ray(t);
+    Vector3f d = lightPoint.coords - x;
+    float dist2 = dotProduct(d, d), dist = std::sqrt(dist2);
+    Vector3f ws = d / dist, wo = -ray.direction;
+    float cosLight = dotProduct(-ws, normalize(lightPoint.normal));
+    if (cosLight <= 0.f) return Vector3f(0.f);
+    Intersection shadowInter = Scene::intersect(Ray(x, ws));
+    if (!shadowInter.happened || std::fabs(shadowInter.distance - dist) >= 0.01) return Vector3f(0.f);
+
+    // power heuristic，三种策略的pdf都换算到（距离，x处立体角）的乘积测度：
+    // 等角采样，距离采样后光源采样，距离采样后相函数采样
+    float G = dist2 / cosLight;
+    float pEq = eqPdf * lightPdf * G;
+    float pLight = distancePdf * pdfLight(x, Vector3f(0.f), lightPoint) * G;
+    float pPhase = distancePdf * medium->pf->pdf(ws, wo);
+    float w = pEq * pEq / (pEq * pEq + pLight * pLight + pPhase * pPhase);
+    float f = albedo * distancePdf * medium->pf->eval(ws, wo) * transmittance(Ray(x, ws), dist) / G;
+    return lightPoint.emit * (f * w / (eqPdf * lightPdf));
+}
+
+// 各介质的碰撞过程相互独立，最近的真实碰撞即叠加后介质的碰撞；后面的介质只需在已有碰撞之前采样
+float Scene::sampleMedium(const Ray &ray, float tMax, float &weight, Medium *&scattering) const
+{
+    float tHit = tMax;
+    weight = 1.f;
+    scattering = nullptr;
+    for (auto &m : media) {
+        float t0, t1, w;
+        if (!m->intersect(ray, tHit, t0, t1)) continue;
+        float t = m->sample(ray, tHit, w);
+        if (t < tHit) {
+            tHit = t;
+            weight = w;
+            scattering = m.get();
+        }
+    }
+    return tHit;
+}
+
+bool Scene::lookupRadianceCache(const Ray &ray, const Intersection &inter, Vector3f &L) const
+{
+    if (!radianceCache || radianceCache->filling || !inter.happened || inter.m->getType() != DIFFUSE) return false;
+    Vector3f n = normalize(inter.normal);
+    if (dotProduct(-ray.direction, n) <= 0.f) return false;
+    return radianceCache->lookup(inter.coords, n, L);
+}
+
  Vector3f Scene::castRayBasic(const Ray &ray) const
  {
     Intersection inter = Scene::intersect(ray);
-    if(!inter.happened) return this->backgroundColor; // 背景色
+    if(!inter.happened) return background(ray.direction); // 背景色 / 环境光
 
     auto pos = inter.coords; // 着色点位置
     auto n = inter.normal.normalized(); // 着色点法线
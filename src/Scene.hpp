@@ -1,5 +1,6 @@
 #pragma once
 
+#include <unordered_map>
 #include "BVH.hpp"
 #include "Vector.hpp"
 #include "Object.hpp"
@@ -7,8 +8,15 @@
 #include "AreaLight.hpp"
 #include "Ray.hpp"
 #include "Medium.hpp"
-#include "HomoMedium.hpp"
 #include "PhaseFunction.hpp"
+#include "AliasTable.hpp"
+#include "LightBVH.hpp"
+#include "EnvironmentLight.hpp"
+#include "Reservoir.hpp"
+#include "PathGuiding.hpp"
+#include "RadianceCache.hpp"
+#include "AOV.hpp"
+#include "MaterialTable.hpp"
 
 class Scene
 {
@@ -19,11 +27,34 @@ public:
     double fov = 40;
     //Vector3f backgroundColor = Vector3f(0.235294, 0.67451, 0.843137);
     Vector3f backgroundColor = 0.f;
+    std::unique_ptr<EnvironmentLight> environment; // 环境光，设置后未击中物体的光线取环境光的radiance，否则取backgroundColor
     Vector3f La = Vector3f(0.1f, 0.1f, 0.1f);
     float RussianRoulette = 0.8; // RR概率
+    bool useLightBVH = false; // 按光源BVH估计的贡献选择发光图元，发光图元很多时开启；否则按功率选择
+    bool sortSecondaryRays = false; // wavefront积分器中，弹射光线按起点所在网格和方向卦限排序后以光线包求交
+    // 直接光照的重采样重要性采样（RIS）：大于0时每个着色点生成risCandidates个光源候选，按未遮挡时的贡献保留一个，只追踪一条阴影光线
+    // 此时直接光照完全由光源采样估计，brdf采样击中光源不再计入（镜面反射除外）
+    int risCandidates = 0;
+    bool risSpatialReuse = false; // wavefront积分器中，第一次弹射时再与同一tile内相邻像素的蓄水池合并
+    // 路径引导：castRayPT在漫反射/微表面着色点的间接光照方向按brdf和在线学习的SD-tree做one-sample MIS
+    // 每次间接弹射追踪得到的入射radiance同时用于训练，训练周期由Renderer在两轮之间结束
+    // 训练时各线程无锁地累加到SD-tree，引导的结果依赖线程调度，开启时渲染结果不能逐位复现，也不支持恢复和分片
+    bool usePathGuiding = false;
+    // radiance缓存：radianceCachePasses大于0时开启，前radianceCachePasses轮把castRayPT在漫反射着色点的出射radiance存入缓存，
+    // 之后的轮中间接光线击中漫反射表面且缓存满足误差要求时直接取缓存值，不再继续追踪（有偏，误差由radianceCacheError控制）
+    int radianceCachePasses = 0;
+    float radianceCacheError = 0.05f; // 允许的相对标准误差
+    float radianceCacheCellSize = 0.f; // 网格边长，0表示场景包围球半径的2%
     
-    std::unique_ptr<PhaseFunction> phase = std::make_unique<HenyeyGreensteinMedium>(0.75f);
-    std::unique_ptr<Medium> medium = std::make_unique<HomoMedium>(0.00025f, 0.0003f, phase.get());
+    // 体积散射（仅castRayPT）：相机光线和间接光线在各介质中独立采样散射点，取最近的一个；阴影光线乘上各介质的透射率
+    // 介质可以充满整个场景（HomoMedium），也可以只存在于包围盒/闭合网格内（BoundedMedium）或体素网格包围盒内（GridMedium），
+    // 光线只在与介质范围相交时才付出体积计算的代价；media为空时不做任何体积计算
+    std::vector<std::unique_ptr<Medium> > media;
+    std::unique_ptr<PhaseFunction> phase = std::make_unique<HenyeyGreensteinMedium>(0.75f); // 介质默认的相函数
+    // 等角采样（refer: Kulla & Fajardo 2012）：场景只有一个距离pdf可解析计算的介质（均匀介质，可以有边界）时，
+    // castRayPT对每条光线在介质中的一段从光线起点采样光源上一点，再按该点所张的角度均匀采样散射距离，估计单次散射的直接光照，
+    // 与距离采样（在散射点做光源采样/相函数采样）按power heuristic做MIS；RIS开启时不使用
+    bool equiangularSampling = false;
 
     Scene(int w, int h) : width(w), height(h) {}
 
@@ -33,13 +64,64 @@ public:
     const std::vector<Object*>& get_objects() const { return objects; }
     const std::vector<std::unique_ptr<Light> >&  get_lights() const { return lights; }
     Intersection intersect(const Ray& ray) const;
+    // 光线包求交，见BVHAccel::IntersectPacket
+    template<int N>
+    void intersectPacket(RayPacket<N> &packet, Intersection *hits, uint32_t mask) const { bvh->IntersectPacket(packet, hits, mask); }
 
-    BVHAccel *bvh;
+    BVHAccel *bvh = nullptr;
     void buildBVH();
+    // 场景中物体所用材质的扁平记录，buildBVH时重新生成，着色时按材质编号查找（见MaterialTable.hpp）
+    MaterialTable materials;
+    // 光源分布，构建BVH时生成：按功率（亮度 * 面积）在发光物体中选择，再在选中的物体上按面积均匀采样
+    // 有环境光时它作为最后一项参与选择；开启光源BVH时以固定概率environmentPmf选择环境光
+    std::vector<Object*> emitters;
+    AliasTable lightDistribution;
+    float environmentPmf = 0.f; // 选中环境光的概率
+    Vector3f sceneCenter; // 场景包围球，环境光采样点放在球外
+    float sceneRadius = 0.f;
+    std::unordered_map<const Object*, int> emitterIndex; // 发光物体及其图元（如网格体的三角形）对应的emitters下标
+    LightBVH *lightBVH = nullptr; // useLightBVH时构建
+    std::unique_ptr<GuidingField> guiding; // usePathGuiding时构建，覆盖场景包围盒
+    std::unique_ptr<RadianceCache> radianceCache; // radianceCachePasses大于0时构建
 
-    Vector3f castRayPT(const Ray &ray) const; //path tracing
+    // 场景哈希（分辨率、视场角以及所有物体的包围盒/面积/是否发光），用于校验断点文件
+    uint64_t hash() const;
+
+    // path tracing；aov不为空时（相机光线）在第一个交点处填写AOV
+    Vector3f castRayPT(const Ray &ray, AOVSample *aov = nullptr) const;
+    Vector3f castRayPT(const Ray &ray, const Intersection &inter, AOVSample *aov = nullptr) const; // 已知ray的交点inter（如光线包求交得到）
     Vector3f castRayBasic(const Ray &ray) const; // whitted-style
-    void sampleLight(Intersection &pos, float &pdf) const;
+    // 阴影光线ray上[0, distance)段的透射率（distance为kInfinity表示到达环境光）：与介质范围不相交的介质直接跳过，
+    // 其余介质的Tr相乘（均匀介质解析计算，非均匀介质用ratio tracking）
+    float transmittance(const Ray &ray, float distance) const;
+    // 在各介质中沿ray的[0, tMax)段独立采样散射距离，返回最近的真实碰撞，scattering为发生碰撞的介质；
+    // 都没有碰撞时返回tMax，scattering为空；weight为对应的系数
+    float sampleMedium(const Ray &ray, float tMax, float &weight, Medium *&scattering) const;
+    // 开启等角采样且ray的[0, tMax)段与介质相交时返回true，[a, b]为相交的范围
+    bool equiangularRange(const Ray &ray, float tMax, float &a, float &b) const;
+    // 在[a, b]上用等角采样估计的单次散射直接光照（已乘MIS权重）
+    Vector3f equiangularScattering(const Ray &ray, float a, float b) const;
+    // 间接光线ray击中漫反射表面inter的正面、且radiance缓存满足误差要求时返回true，L为缓存的出射radiance
+    bool lookupRadianceCache(const Ray &ray, const Intersection &inter, Vector3f &L) const;
+    // 为着色点p（法线n，零向量表示介质中的散射点）采样光源上的一点，pdf为面积度量
+    // 选中环境光时，pos.obj为空，采样点沿采样方向放在场景包围球外，法线朝向p，面积pdf与立体角pdf按距离平方换算，
+    // 阴影光线没有击中任何物体即可见
+    void sampleLight(const Vector3f &p, const Vector3f &n, Intersection &pos, float &pdf) const;
+    // 在着色点p处用sampleLight采样到光源点lightPoint的pdf（面积度量），用于击中光源时的MIS
+    // 光源上的点按立体角采样（球面三角形/球面矩形/球的可见锥），pdf依赖参考点p
+    float pdfLight(const Vector3f &p, const Vector3f &n, const Intersection &lightPoint) const;
+    // 用sampleLight采样到环境光方向w的pdf（立体角度量），用于光线未击中物体时的MIS
+    // 两种光源选择方式下选中环境光的概率都是environmentPmf，与着色点无关
+    float pdfEnvironment(const Vector3f &w) const;
+    // 光源点lightPoint在着色点p（法线n，出射方向wo）处未被遮挡时的贡献Le * f * cos * cos' / dis^2（面积度量）
+    // m为空表示介质中的散射点，f为相位函数pf（为空时取phase），不乘cos
+    Vector3f unshadowedLight(const Vector3f &p, const Vector3f &n, const Vector3f &wo, Material *m,
+                             const Vector2f &tcoords, const Intersection &lightPoint, PhaseFunction *pf = nullptr) const;
+    // 用sampleLight生成risCandidates个候选，以unshadowedLight的亮度为目标函数做蓄水池采样
+    void sampleLightRIS(const Vector3f &p, const Vector3f &n, const Vector3f &wo, Material *m,
+                        const Vector2f &tcoords, Reservoir &r, PhaseFunction *pf = nullptr) const;
+    // 光线未击中物体时的radiance
+    Vector3f background(const Vector3f &dir) const { return environment ? environment->Le(dir) : backgroundColor; }
     // bool trace(const Ray &ray, const std::vector<Object*> &objects, float &tNear, uint32_t &index, Object **hitObject);
     
     std::tuple<Vector3f, Vector3f> HandleAreaLight(const AreaLight &light, const Vector3f &hitPoint, const Vector3f &N,
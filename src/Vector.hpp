@@ -90,3 +90,7 @@ inline Vector3f pow(const Vector3f &a, float b)
 {
     return Vector3f(std::pow(a.x, b), std::pow(a.y, b), std::pow(a.z, b));
 }
+
+// 亮度（Rec.709），用于按功率比较光源
+inline float luminance(const Vector3f &v)
+{ return 0.2126f * v.x + 0.7152f * v.y + 0.0722f * v.z; }
@@ -0,0 +1,524 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include "Wavefront.hpp"
+#include "ShadingBatch.hpp"
+#include "global.hpp"
+#include <mingw.thread.h>
+
+static const int CHUNK_SIZE = 256; // parallelFor每块处理的元素数
+static const int SORT_CELL_BITS = 9; // 排序键中起点网格每个轴的位数
+static const int SORT_KEY_BITS = 3 * SORT_CELL_BITS + 3; // 方向卦限(3位) + 起点网格的Morton码
+static const int RIS_TILE_SIZE = 16; // 空间复用只在同一tile（16 x 16像素）内选取相邻像素
+static const int RIS_NEIGHBORS = 4; // 空间复用合并的相邻像素数
+static const int RIS_RADIUS = 8; // 相邻像素的最大距离（像素）
+
+// 把v的低10位间隔两位展开，用于拼Morton码
+static inline uint32_t expandBits(uint32_t v)
+{
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v << 8)) & 0x0300F00F;
+    v = (v | (v << 4)) & 0x030C30C3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void PathQueue::resize(int n)
+{
+    for (auto v : {&ox, &oy, &oz, &dx, &dy, &dz, &beta_r, &beta_g, &beta_b, &pdf, &nx, &ny, &nz}) v->resize(n);
+    path.resize(n);
+}
+
+void ShadowQueue::resize(int n)
+{
+    for (auto v : {&ox, &oy, &oz, &dx, &dy, &dz, &distance, &L_r, &L_g, &L_b}) v->resize(n);
+    environment.resize(n);
+    path.resize(n);
+}
+
+template<typename Kernel>
+void WavefrontIntegrator::parallelFor(int count, uint64_t stageSeed, const Kernel &kernel)
+{
+    int chunkNum = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    std::atomic<int> nextChunk(0);
+    auto worker = [&](){
+        for (int c = nextChunk++; c < chunkNum; c = nextChunk++) {
+            seed_random((uint32_t)hash_combine(stageSeed, c));
+            kernel(c * CHUNK_SIZE, std::min(count, (c + 1) * CHUNK_SIZE));
+        }
+    };
+    int workerNum = std::min(thread_num, chunkNum);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < workerNum; ++i) threads.emplace_back(worker);
+    worker(); // 当前线程也参与计算
+    for (auto &t : threads) t.join();
+}
+
+void WavefrontIntegrator::render(Film &film, int rowBegin, int rowEnd, int sampleBegin, int passBegin, int passEnd, uint64_t seed)
+{
+    // 统计这一批需要的路径，每个像素每个未完成的采样对应一条路径
+    std::vector<int> pixels;
+    for (int j = rowBegin; j < rowEnd; ++j) {
+        for (int i = 0; i < film.width; ++i) {
+            int index = j * film.width + i;
+            for (int k = std::max<int>(passBegin, sampleBegin + film.sampleCount[index]); k < passEnd; ++k)
+                pixels.push_back(index);
+        }
+    }
+
+    for (size_t first = 0; first < pixels.size(); first += maxPaths) {
+        size_t last = std::min(pixels.size(), first + maxPaths);
+        std::vector<int> batch(pixels.begin() + first, pixels.begin() + last);
+        uint64_t batchSeed = hash_combine(seed, first);
+
+        generate(batch, batchSeed);
+        for (int depth = 0; rays.size > 0; ++depth) {
+            uint64_t depthSeed = hash_combine(batchSeed, depth + 1);
+            extend(depthSeed, depth);
+            shade(depthSeed, depth);
+            if (depth == 0 && scene.risCandidates > 0 && scene.risSpatialReuse) spatialReuse(depthSeed);
+            connect(depthSeed, depth);
+            compact();
+            if (scene.sortSecondaryRays && rays.size > 0) sortRays();
+        }
+
+        for (size_t p = 0; p < batch.size(); ++p) {
+            film.addSample(batch[p], Vector3f(L_r[p], L_g[p], L_b[p]));
+        }
+    }
+}
+
+// 生成相机光线，初始化每条路径的状态
+void WavefrontIntegrator::generate(const std::vector<int> &pixels, uint64_t seed)
+{
+    int n = pixels.size();
+    rays.resize(n); nextRays.resize(n); shadowRays.resize(n);
+    hits.resize(n); alive.resize(n); shadowValid.resize(n);
+    pixel = pixels;
+    L_r.assign(n, 0.f); L_g.assign(n, 0.f); L_b.assign(n, 0.f);
+    rays.size = n;
+    if (scene.risCandidates > 0) {
+        reservoirs.resize(n); reservoirValid.resize(n);
+        if (scene.risSpatialReuse) {
+            reusedReservoirs.resize(n);
+            // 同一像素的各个采样在pixels中连续存放
+            firstPath.assign(camera.width * camera.height, -1);
+            pathCount.assign(camera.width * camera.height, 0);
+            for (int p = 0; p < n; ++p) {
+                if (firstPath[pixels[p]] < 0) firstPath[pixels[p]] = p;
+                pathCount[pixels[p]]++;
+            }
+        }
+    }
+
+    parallelFor(n, seed, [&](int begin, int end){
+        for (int p = begin; p < end; ++p) {
+            int i = pixels[p] % camera.width, j = pixels[p] / camera.width;
+            Ray ray = camera.generateRay(i + 0.5f, j + 0.5f);
+            rays.setRay(p, ray.origin, ray.direction);
+            rays.beta_r[p] = rays.beta_g[p] = rays.beta_b[p] = 1.f;
+            rays.pdf[p] = 0.f;
+            rays.nx[p] = rays.ny[p] = rays.nz[p] = 0.f;
+            rays.path[p] = p;
+        }
+    });
+}
+
+// 队列中相邻的N条光线组成光线包（相机光线来自相邻像素，排序后的弹射光线起点相近、方向同卦限，一致性高）
+template<int N>
+void WavefrontIntegrator::extendPackets(int begin, int end)
+{
+    for (int i = begin; i < end; i += N) {
+        int lanes = std::min(N, end - i);
+        RayPacket<N> packet{};
+        for (int l = 0; l < lanes; ++l) {
+            packet.set(l, rays.getRay(i + l));
+            hits[i + l] = Intersection();
+        }
+        scene.intersectPacket(packet, &hits[i], (1u << lanes) - 1);
+    }
+}
+
+// 求每条光线的最近交点，相机光线使用光线包
+// 之后的光线方向发散，未排序时逐条求交；排序后相邻光线起点相近、方向同卦限，同样组成光线包
+void WavefrontIntegrator::extend(uint64_t seed, int depth)
+{
+    auto start = std::chrono::steady_clock::now();
+    parallelFor(rays.size, hash_combine(seed, 1), [&](int begin, int end){
+        if ((depth == 0 || scene.sortSecondaryRays) && packetSize > 1) {
+            switch (packetSize) {
+                case 4: extendPackets<4>(begin, end); break;
+                case 16: extendPackets<16>(begin, end); break;
+                default: extendPackets<8>(begin, end); break;
+            }
+            return;
+        }
+        for (int i = begin; i < end; ++i) hits[i] = scene.intersect(rays.getRay(i));
+    });
+    if (depth > 0) {
+        stats.secondaryRays += rays.size;
+        stats.extendSeconds += secondsSince(start);
+    }
+}
+
+// 着色：处理击中光源/未击中的路径，对光源采样生成阴影光线，对brdf采样生成下一段光线
+// 每块内先收集需要计算brdf的着色点，再用ShadingBatch按材质分组批量计算，最后写回阴影光线和下一段光线
+// 开启RIS时，光源采样改为蓄水池采样，每个着色点单独计算候选的brdf；第一次弹射需要空间复用时阴影光线由spatialReuse生成
+void WavefrontIntegrator::shade(uint64_t seed, int depth)
+{
+    bool useRIS = scene.risCandidates > 0;
+    bool deferRIS = useRIS && scene.risSpatialReuse && depth == 0;
+    parallelFor(rays.size, hash_combine(seed, 2), [&](int begin, int end){
+        thread_local ShadingBatch lightBatch, bsdfBatch; // 光源方向的brdf / brdf采样
+        thread_local std::vector<int> lightIndex, bsdfIndex; // 批中每项对应的队列下标
+        thread_local std::vector<float> lightCos, lightPdfs; // 光源采样的costheta和立体角pdf
+        lightBatch.clear(); bsdfBatch.clear();
+        lightIndex.clear(); bsdfIndex.clear();
+        lightCos.clear(); lightPdfs.clear();
+
+        for (int i = begin; i < end; ++i) {
+            alive[i] = 0;
+            shadowValid[i] = 0;
+            if (useRIS) reservoirValid[i] = 0;
+            int p = rays.path[i];
+            Ray ray = rays.getRay(i);
+            Vector3f beta = rays.getBeta(i);
+            const Intersection &inter = hits[i];
+
+            // 未击中物体：背景色，或与击中光源相同，到达环境光并与光源采样做MIS
+            if (!inter.happened) {
+                float w = 1.f;
+                float bsdfPdf = rays.pdf[i];
+                if (scene.environment && bsdfPdf > 0.f && useRIS) w = 0.f; // 直接光照完全由RIS估计
+                else if (scene.environment && bsdfPdf > 0.f) {
+                    float lightPdf = scene.pdfEnvironment(ray.direction);
+                    w = bsdfPdf * bsdfPdf / (bsdfPdf * bsdfPdf + lightPdf * lightPdf);
+                }
+                Vector3f L = beta * scene.background(ray.direction) * w;
+                L_r[p] += L.x; L_g[p] += L.y; L_b[p] += L.z;
+                continue;
+            }
+
+            // 光线打到光源，路径结束
+            // 相机光线和镜面反射直接计入，否则与光源采样做MIS
+            if (inter.m->hasEmission()) {
+                float w = 1.f;
+                float bsdfPdf = rays.pdf[i];
+                if (bsdfPdf > 0.f) {
+                    float cos_light = dotProduct(-ray.direction, normalize(inter.normal));
+                    Vector3f prevN(rays.nx[i], rays.ny[i], rays.nz[i]);
+                    float lightPdf = cos_light > 0.f ?
+                        scene.pdfLight(ray.origin, prevN, inter) * inter.distance * inter.distance / cos_light : 0.f;
+                    // RIS只估计光源采样能得到的部分，其余（如光源背面）仍由brdf采样计入
+                    if (useRIS) w = lightPdf > 0.f ? 0.f : 1.f;
+                    else w = bsdfPdf * bsdfPdf / (bsdfPdf * bsdfPdf + lightPdf * lightPdf);
+                }
+                Vector3f L = beta * inter.m->getEmission() * w;
+                L_r[p] += L.x; L_g[p] += L.y; L_b[p] += L.z;
+                continue;
+            }
+
+            // 透明材质只用于whitted-style
+            if (inter.m->getType() == TRANSPARENT) continue;
+
+            auto pos = inter.coords;
+            auto n = normalize(inter.normal);
+            auto wo = -ray.direction;
+            Vector3f pos_deviation = (dotProduct(ray.direction, n) < 0) ?
+                                pos + n * EPSILON :
+                                pos - n * EPSILON ;
+            bool isMirror = inter.m->getType() == MIRROR;
+
+            if (useRIS && !isMirror) {
+                Reservoir &r = reservoirs[i];
+                r = Reservoir();
+                scene.sampleLightRIS(pos_deviation, n, wo, inter.m, inter.tcoords, r);
+                reservoirValid[i] = 1;
+                if (!deferRIS) setShadowRay(i, pos_deviation, inter, wo, r, beta);
+            }
+
+            // 直接光照：对光源采样，阴影光线的贡献先记为beta * emit，brdf算出后再补上
+            Intersection lightPoint;
+            float lightPdf = 0.f;
+            if (!useRIS) scene.sampleLight(pos_deviation, n, lightPoint, lightPdf); // 参考点与下一段光线的起点一致，击中光源时可以重算pdf
+            Vector3f toLight = lightPoint.coords - pos;
+            float dis2 = dotProduct(toLight, toLight);
+            float dis = std::sqrt(dis2);
+            Vector3f ws = toLight / dis;
+            float costheta_prime = dotProduct(-ws, normalize(lightPoint.normal));
+            float costheta = dotProduct(ws, n);
+            if (!useRIS && !isMirror && lightPdf > 0.f && costheta > 0.f && costheta_prime > 0.f) {
+                Vector3f L = beta * lightPoint.emit;
+                shadowRays.ox[i] = pos_deviation.x; shadowRays.oy[i] = pos_deviation.y; shadowRays.oz[i] = pos_deviation.z;
+                shadowRays.dx[i] = ws.x; shadowRays.dy[i] = ws.y; shadowRays.dz[i] = ws.z;
+                shadowRays.distance[i] = dis;
+                shadowRays.environment[i] = lightPoint.obj == nullptr;
+                shadowRays.L_r[i] = L.x; shadowRays.L_g[i] = L.y; shadowRays.L_b[i] = L.z;
+                shadowRays.path[i] = p;
+                lightBatch.add(inter.m, wo, n, inter.tcoords, ws);
+                lightIndex.push_back(i);
+                lightCos.push_back(costheta);
+                lightPdfs.push_back(dis2 * lightPdf / costheta_prime); // 转换为立体角pdf
+            }
+
+            // 间接光照：俄罗斯轮盘赌后对brdf采样，下一段光线的起点和throughput先写入
+            if (get_random_float() >= scene.RussianRoulette) continue;
+            nextRays.ox[i] = pos_deviation.x; nextRays.oy[i] = pos_deviation.y; nextRays.oz[i] = pos_deviation.z;
+            nextRays.setBeta(i, beta);
+            nextRays.nx[i] = n.x; nextRays.ny[i] = n.y; nextRays.nz[i] = n.z;
+            nextRays.path[i] = p;
+            bsdfBatch.add(inter.m, wo, n, inter.tcoords);
+            bsdfIndex.push_back(i);
+        }
+
+        lightBatch.eval(scene.materials);
+        bsdfBatch.sample(scene.materials);
+
+        for (int k = 0; k < lightBatch.size; ++k) {
+            int i = lightIndex[k];
+            float lightPdf_mis = lightPdfs[k];
+            float frPdf = lightBatch.pdf[k];
+            float w = lightPdf_mis * lightPdf_mis / (lightPdf_mis * lightPdf_mis + frPdf * frPdf);
+            Vector3f scale = lightBatch.f[k] * lightCos[k] * w / lightPdf_mis;
+            shadowRays.L_r[i] *= scale.x; shadowRays.L_g[i] *= scale.y; shadowRays.L_b[i] *= scale.z;
+            shadowValid[i] = 1;
+        }
+
+        for (int k = 0; k < bsdfBatch.size; ++k) {
+            int i = bsdfIndex[k];
+            float pdf = bsdfBatch.pdf[k];
+            if (pdf <= 0.f) continue;
+            const Vector3f &wi = bsdfBatch.wi[k];
+            Vector3f beta = nextRays.getBeta(i) * bsdfBatch.f[k] * dotProduct(wi, bsdfBatch.N[k]) / (pdf * scene.RussianRoulette);
+            nextRays.dx[i] = wi.x; nextRays.dy[i] = wi.y; nextRays.dz[i] = wi.z;
+            nextRays.setBeta(i, beta);
+            nextRays.pdf[i] = scene.materials.record(bsdfBatch.material[k]).type == MIRROR ? 0.f : pdf;
+            alive[i] = 1;
+        }
+    });
+}
+
+void WavefrontIntegrator::setShadowRay(int i, const Vector3f &origin, const Intersection &inter, const Vector3f &wo,
+                                       const Reservoir &r, const Vector3f &beta)
+{
+    if (r.W <= 0.f) return;
+    Vector3f n = normalize(inter.normal);
+    Vector3f L = beta * scene.unshadowedLight(origin, n, wo, inter.m, inter.tcoords, r.y) * r.W;
+    if (L.x <= 0.f && L.y <= 0.f && L.z <= 0.f) return;
+    Vector3f toLight = r.y.coords - origin;
+    float dis = toLight.norm();
+    Vector3f ws = toLight / dis;
+    shadowRays.ox[i] = origin.x; shadowRays.oy[i] = origin.y; shadowRays.oz[i] = origin.z;
+    shadowRays.dx[i] = ws.x; shadowRays.dy[i] = ws.y; shadowRays.dz[i] = ws.z;
+    shadowRays.distance[i] = dis;
+    shadowRays.environment[i] = r.y.obj == nullptr;
+    shadowRays.L_r[i] = L.x; shadowRays.L_g[i] = L.y; shadowRays.L_b[i] = L.z;
+    shadowRays.path[i] = rays.path[i];
+    shadowValid[i] = 1;
+}
+
+// 空间复用（第一次弹射）：每个着色点再随机选同一tile内RIS_NEIGHBORS个相邻像素，把它们的蓄水池合并进来，
+// 相当于免费获得了更多候选；法线或深度相差过大的相邻像素不参与合并
+// 合并后的W用所有目标函数在选中样本处不为0的蓄水池的候选数归一化（1 / Z），相邻像素无法采样到的样本不会引入偏差
+// 读取reservoirs、写入reusedReservoirs，完成后交换，因此与处理顺序无关
+void WavefrontIntegrator::spatialReuse(uint64_t seed)
+{
+    // 与shade相同的着色点法线、出射方向和偏移后的位置（蓄水池的目标函数以偏移后的位置为参考点）
+    auto shadingFrame = [&](int i, Vector3f &n, Vector3f &wo, Vector3f &origin){
+        n = normalize(hits[i].normal);
+        wo = -Vector3f(rays.dx[i], rays.dy[i], rays.dz[i]);
+        origin = dotProduct(wo, n) > 0 ? hits[i].coords + n * EPSILON : hits[i].coords - n * EPSILON;
+    };
+    int n = rays.size;
+    parallelFor(n, hash_combine(seed, 4), [&](int begin, int end){
+        for (int i = begin; i < end; ++i) {
+            if (!reservoirValid[i]) continue;
+            int p = rays.path[i]; // 第一次弹射时路径编号与队列下标相同
+            int pix = pixel[p], px = pix % camera.width, py = pix / camera.width;
+            int sample = p - firstPath[pix];
+            const Intersection &inter = hits[i];
+            Vector3f n, wo, origin;
+            shadingFrame(i, n, wo, origin);
+
+            int tileX = px / RIS_TILE_SIZE * RIS_TILE_SIZE, tileY = py / RIS_TILE_SIZE * RIS_TILE_SIZE;
+            int candidates[RIS_NEIGHBORS + 1] = {i};
+            int count = 1;
+            for (int k = 0; k < RIS_NEIGHBORS; ++k) {
+                int qx = px + (int)std::floor((2 * get_random_float() - 1) * RIS_RADIUS);
+                int qy = py + (int)std::floor((2 * get_random_float() - 1) * RIS_RADIUS);
+                qx = std::max(tileX, std::min(std::min(tileX + RIS_TILE_SIZE, camera.width) - 1, qx));
+                qy = std::max(tileY, std::min(std::min(tileY + RIS_TILE_SIZE, camera.height) - 1, qy));
+                int q = qy * camera.width + qx;
+                if (q == pix || firstPath[q] < 0 || sample >= pathCount[q]) continue;
+                int j = firstPath[q] + sample;
+                if (!reservoirValid[j]) continue;
+                // 几何相似性：法线夹角小于约25度，到相机的距离相差不超过10%
+                const Intersection &other = hits[j];
+                if (dotProduct(n, normalize(other.normal)) < 0.9f) continue;
+                if (std::fabs(other.distance - inter.distance) > 0.1 * inter.distance) continue;
+                candidates[count++] = j;
+            }
+
+            Reservoir r;
+            for (int c = 0; c < count; ++c) {
+                const Reservoir &other = reservoirs[candidates[c]];
+                float pHat = c == 0 ? other.pHat : luminance(scene.unshadowedLight(origin, n, wo, inter.m, inter.tcoords, other.y));
+                r.merge(other, pHat, get_random_float());
+            }
+            // Z：目标函数在选中样本处不为0的蓄水池的候选数之和
+            float Z = 0.f;
+            for (int c = 0; c < count; ++c) {
+                int j = candidates[c];
+                Vector3f nj, woj, originj;
+                shadingFrame(j, nj, woj, originj);
+                if (luminance(scene.unshadowedLight(originj, nj, woj, hits[j].m, hits[j].tcoords, r.y)) > 0.f) Z += reservoirs[j].M;
+            }
+            r.W = r.pHat > 0.f && Z > 0.f ? r.wSum / (Z * r.pHat) : 0.f;
+            reusedReservoirs[i] = r;
+            setShadowRay(i, origin, inter, wo, r, rays.getBeta(i));
+        }
+    });
+    reservoirs.swap(reusedReservoirs);
+}
+
+// 以光线包追踪阴影光线，只需找到光源采样点附近（distance + 0.01）以内的最近交点
+template<int N>
+void WavefrontIntegrator::connectPackets(int begin, int end)
+{
+    for (int i = begin; i < end; i += N) {
+        int lanes = std::min(N, end - i);
+        RayPacket<N> packet{};
+        Intersection shadowHits[N];
+        uint32_t mask = 0;
+        for (int l = 0; l < lanes; ++l) {
+            if (!shadowValid[i + l]) continue;
+            Ray shadowRay(Vector3f(shadowRays.ox[i + l], shadowRays.oy[i + l], shadowRays.oz[i + l]),
+                          Vector3f(shadowRays.dx[i + l], shadowRays.dy[i + l], shadowRays.dz[i + l]));
+            packet.set(l, shadowRay, shadowRays.distance[i + l] + 0.01f);
+            mask |= 1u << l;
+        }
+        if (!mask) continue;
+        scene.intersectPacket(packet, shadowHits, mask);
+        for (uint32_t bits = mask; bits; bits &= bits - 1) {
+            int l = __builtin_ctz(bits);
+            if (reachesLight(shadowHits[l], i + l)) {
+                int p = shadowRays.path[i + l];
+                L_r[p] += shadowRays.L_r[i + l]; L_g[p] += shadowRays.L_g[i + l]; L_b[p] += shadowRays.L_b[i + l];
+            }
+        }
+    }
+}
+
+// 追踪阴影光线，未被遮挡则累加直接光照
+// 第一次弹射的阴影光线起点相邻且都指向光源，使用光线包
+void WavefrontIntegrator::connect(uint64_t seed, int depth)
+{
+    parallelFor(rays.size, hash_combine(seed, 3), [&](int begin, int end){
+        if (depth == 0 && packetSize > 1) {
+            switch (packetSize) {
+                case 4: connectPackets<4>(begin, end); break;
+                case 16: connectPackets<16>(begin, end); break;
+                default: connectPackets<8>(begin, end); break;
+            }
+            return;
+        }
+        for (int i = begin; i < end; ++i) {
+            if (!shadowValid[i]) continue;
+            Ray shadowRay(Vector3f(shadowRays.ox[i], shadowRays.oy[i], shadowRays.oz[i]),
+                          Vector3f(shadowRays.dx[i], shadowRays.dy[i], shadowRays.dz[i]));
+            Intersection shadowInter = scene.intersect(shadowRay);
+            if (reachesLight(shadowInter, i)) {
+                int p = shadowRays.path[i];
+                L_r[p] += shadowRays.L_r[i]; L_g[p] += shadowRays.L_g[i]; L_b[p] += shadowRays.L_b[i];
+            }
+        }
+    });
+}
+
+// 去掉已经终止的路径，存活的路径紧凑地放到队列前部（保持原有顺序）
+void WavefrontIntegrator::compact()
+{
+    int count = 0;
+    for (int i = 0; i < rays.size; ++i) {
+        if (!alive[i]) continue;
+        rays.ox[count] = nextRays.ox[i]; rays.oy[count] = nextRays.oy[i]; rays.oz[count] = nextRays.oz[i];
+        rays.dx[count] = nextRays.dx[i]; rays.dy[count] = nextRays.dy[i]; rays.dz[count] = nextRays.dz[i];
+        rays.beta_r[count] = nextRays.beta_r[i]; rays.beta_g[count] = nextRays.beta_g[i]; rays.beta_b[count] = nextRays.beta_b[i];
+        rays.pdf[count] = nextRays.pdf[i];
+        rays.nx[count] = nextRays.nx[i]; rays.ny[count] = nextRays.ny[i]; rays.nz[count] = nextRays.nz[i];
+        rays.path[count] = nextRays.path[i];
+        ++count;
+    }
+    rays.size = count;
+}
+
+// 按方向卦限和起点所在网格（场景包围盒划分为2^9 x 2^9 x 2^9，按Morton码排列）对光线排序
+// 卦限相同、起点相近的光线在BVH中访问的节点相近，连续求交时缓存命中率更高
+// 排序只改变光线在队列中的顺序，路径仍由path找到自己的像素，估计量不变
+void WavefrontIntegrator::sortRays()
+{
+    auto start = std::chrono::steady_clock::now();
+    int n = rays.size;
+    sortItems.resize(n);
+    sortTemp.resize(n);
+
+    const Bounds3 &bounds = scene.bvh->root->bounds;
+    Vector3f extent = bounds.Diagonal();
+    const float cells = (float)(1 << SORT_CELL_BITS);
+    Vector3f scale(extent.x > 0.f ? cells / extent.x : 0.f,
+                   extent.y > 0.f ? cells / extent.y : 0.f,
+                   extent.z > 0.f ? cells / extent.z : 0.f);
+    auto cell = [cells](float v){ return (uint32_t)clamp(0.f, cells - 1.f, v); };
+
+    parallelFor(n, 0, [&](int begin, int end){
+        for (int i = begin; i < end; ++i) {
+            uint32_t morton = (expandBits(cell((rays.ox[i] - bounds.pMin.x) * scale.x)) << 2) |
+                              (expandBits(cell((rays.oy[i] - bounds.pMin.y) * scale.y)) << 1) |
+                              expandBits(cell((rays.oz[i] - bounds.pMin.z) * scale.z));
+            uint32_t octant = (rays.dx[i] < 0.f) << 2 | (rays.dy[i] < 0.f) << 1 | (rays.dz[i] < 0.f);
+            uint32_t key = octant << (3 * SORT_CELL_BITS) | morton;
+            sortItems[i] = (uint64_t)key << 32 | (uint32_t)i;
+        }
+    });
+
+    // LSD基数排序，每趟8位，只排键值所在的高位
+    for (int shift = 32; shift < 32 + SORT_KEY_BITS; shift += 8) {
+        uint32_t count[257] = {};
+        for (int i = 0; i < n; ++i) count[((sortItems[i] >> shift) & 0xFF) + 1]++;
+        if (count[((sortItems[0] >> shift) & 0xFF) + 1] == (uint32_t)n) continue; // 这一趟所有键值相同
+        for (int b = 0; b < 256; ++b) count[b + 1] += count[b];
+        for (int i = 0; i < n; ++i) sortTemp[count[(sortItems[i] >> shift) & 0xFF]++] = sortItems[i];
+        sortItems.swap(sortTemp);
+    }
+
+    // 按排序结果重排到nextRays，再交换两个队列（nextRays之后会被shade覆盖）
+    parallelFor(n, 0, [&](int begin, int end){
+        for (int i = begin; i < end; ++i) {
+            int k = (int)(uint32_t)sortItems[i];
+            nextRays.ox[i] = rays.ox[k]; nextRays.oy[i] = rays.oy[k]; nextRays.oz[i] = rays.oz[k];
+            nextRays.dx[i] = rays.dx[k]; nextRays.dy[i] = rays.dy[k]; nextRays.dz[i] = rays.dz[k];
+            nextRays.beta_r[i] = rays.beta_r[k]; nextRays.beta_g[i] = rays.beta_g[k]; nextRays.beta_b[i] = rays.beta_b[k];
+            nextRays.pdf[i] = rays.pdf[k];
+            nextRays.nx[i] = rays.nx[k]; nextRays.ny[i] = rays.ny[k]; nextRays.nz[i] = rays.nz[k];
+            nextRays.path[i] = rays.path[k];
+        }
+    });
+    std::swap(rays, nextRays);
+    rays.size = n;
+
+    stats.sortSeconds += secondsSince(start);
+}
+
+void WavefrontIntegrator::printStats() const
+{
+    if (stats.secondaryRays == 0) return;
+    std::cout << "Secondary rays: " << stats.secondaryRays
+              << ", extend " << stats.extendSeconds << "s ("
+              << stats.secondaryRays / stats.extendSeconds * 1e-6 << " Mrays/s)"
+              << ", sort " << stats.sortSeconds << "s\n";
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "Scene.hpp"
+#include "Camera.hpp"
+#include "Film.hpp"
+
+// SoA形式存储的一组光线/路径状态，每个分量连续存放，便于各阶段的循环向量化
+struct PathQueue
+{
+    std::vector<float> ox, oy, oz; // 光线起点
+    std::vector<float> dx, dy, dz; // 光线方向
+    std::vector<float> beta_r, beta_g, beta_b; // 路径throughput
+    std::vector<float> pdf; // 生成当前光线的方向采样pdf，击中光源时用于MIS；0表示相机光线或镜面反射
+    std::vector<float> nx, ny, nz; // 生成当前光线的着色点法线，击中光源时计算光源采样的pdf（起点即着色点）
+    std::vector<int> path; // 所属路径编号
+    int size = 0;
+
+    void resize(int n);
+    Ray getRay(int i) const { return Ray(Vector3f(ox[i], oy[i], oz[i]), Vector3f(dx[i], dy[i], dz[i])); }
+    void setRay(int i, const Vector3f &o, const Vector3f &d) {
+        ox[i] = o.x; oy[i] = o.y; oz[i] = o.z;
+        dx[i] = d.x; dy[i] = d.y; dz[i] = d.z;
+    }
+    Vector3f getBeta(int i) const { return Vector3f(beta_r[i], beta_g[i], beta_b[i]); }
+    void setBeta(int i, const Vector3f &b) { beta_r[i] = b.x; beta_g[i] = b.y; beta_b[i] = b.z; }
+};
+
+// 阴影光线队列，可见时把contribution加到对应路径上
+struct ShadowQueue
+{
+    std::vector<float> ox, oy, oz;
+    std::vector<float> dx, dy, dz;
+    std::vector<float> distance; // 到光源采样点的距离
+    std::vector<uint8_t> environment; // 指向环境光，没有击中任何物体即可见
+    std::vector<float> L_r, L_g, L_b; // 未被遮挡时的贡献
+    std::vector<int> path;
+    int size = 0;
+
+    void resize(int n);
+};
+
+// Wavefront(stream) path tracing
+// 不再对每个采样递归追踪完整路径，而是把一大批路径的状态存在SoA缓冲中，按阶段逐批处理：
+// generate(生成相机光线) -> extend(求最近交点) -> shade(着色，采样下一个方向和光源) -> connect(追踪阴影光线)
+// 每个阶段是一个紧凑的并行循环，同一阶段内的指令和数据访问更集中，对指令缓存和数据缓存更友好
+// 估计量与castRayPT相同：光源采样和brdf采样的直接光照用MIS(beta = 2)组合，俄罗斯轮盘赌终止路径
+class WavefrontIntegrator
+{
+public:
+    WavefrontIntegrator(const Scene &scene, const Camera &camera, int thread_num)
+        : scene(scene), camera(camera), thread_num(thread_num) {}
+
+    int maxPaths = 1 << 18; // 一批最多同时处理的路径数
+    int packetSize = 8; // 相机光线和第一次弹射的阴影光线以光线包（4/8/16）求交，小于等于1时逐条求交
+
+    // 渲染行[rowBegin, rowEnd)中每个像素采样序号在[passBegin, passEnd)中尚未完成的采样，结果累加到film
+    // sampleBegin是film中采样数为0时对应的采样序号，seed决定这一批的随机序列
+    void render(Film &film, int rowBegin, int rowEnd, int sampleBegin, int passBegin, int passEnd, uint64_t seed);
+
+    // 弹射光线（depth >= 1）的统计，用于比较排序的开销和求交节省的时间
+    struct Stats
+    {
+        uint64_t secondaryRays = 0; // 求交的弹射光线数
+        double sortSeconds = 0.0; // 排序（计算键值、基数排序、重排队列）耗时
+        double extendSeconds = 0.0; // 弹射光线求交耗时
+    } stats;
+    void printStats() const;
+
+private:
+    const Scene &scene;
+    const Camera &camera;
+    int thread_num;
+
+    PathQueue rays, nextRays;
+    ShadowQueue shadowRays;
+    std::vector<Intersection> hits;
+    std::vector<uint8_t> alive, shadowValid;
+    std::vector<int> pixel; // 每条路径对应的像素
+    std::vector<float> L_r, L_g, L_b; // 每条路径累积的radiance
+    std::vector<uint64_t> sortItems, sortTemp; // 排序用的(键值 << 32 | 下标)
+    // RIS直接光照：每条路径当前着色点的蓄水池，空间复用时写入reused后交换
+    std::vector<Reservoir> reservoirs, reusedReservoirs;
+    std::vector<uint8_t> reservoirValid;
+    std::vector<int> firstPath, pathCount; // 每个像素在这一批中的第一条路径及路径数，空间复用时查找相邻像素
+
+    // 按固定大小的块并行执行kernel(begin, end)，每块的随机种子由stageSeed和块号决定，结果与线程数无关
+    template<typename Kernel>
+    void parallelFor(int count, uint64_t stageSeed, const Kernel &kernel);
+
+    void generate(const std::vector<int> &pixels, uint64_t seed);
+    void extend(uint64_t seed, int depth);
+    void shade(uint64_t seed, int depth);
+    void spatialReuse(uint64_t seed);
+    // 由蓄水池选中的光源样本生成阴影光线i，贡献为beta * 未遮挡的贡献 * W
+    void setShadowRay(int i, const Vector3f &origin, const Intersection &inter, const Vector3f &wo,
+                      const Reservoir &r, const Vector3f &beta);
+    void connect(uint64_t seed, int depth);
+
+    // 以光线包对[begin, end)中的光线/阴影光线求交
+    template<int N> void extendPackets(int begin, int end);
+    template<int N> void connectPackets(int begin, int end);
+    // 阴影光线i的最近交点为hit时是否到达光源：与castRayPT相同，光线一定会打到光源点上，除非被遮挡；环境光则要求没有交点
+    bool reachesLight(const Intersection &hit, int i) const
+    {
+        if (shadowRays.environment[i]) return !hit.happened;
+        return hit.happened && fabs(hit.distance - shadowRays.distance[i]) < 0.01;
+    }
+    void compact();
+    void sortRays();
+};
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <cmath>
 #include <random>
+#include <cstdint>
 
 #undef M_PI
 #define M_PI 3.141592653589793f
@@ -30,14 +31,46 @@ inline bool solveQuadratic(const float &a, const float &b, const float &c, float
 }
 
 // windows下需要加static，修改后能显著提高效率
+// 每个线程独立一个随机数引擎（thread_local），避免多线程竞争同一个引擎
+inline std::mt19937& get_random_engine()
+{
+    static thread_local std::random_device dev; // 随机设备dev，以dev生成的随机数为随机种子
+    static thread_local std::mt19937 rng(dev()); // 使用梅森旋转算法生成伪随机数，以dev为种子
+    return rng;
+}
+
+// 重新设定当前线程的随机数种子，用于断点续渲时复现采样器状态
+inline void seed_random(uint32_t seed)
+{
+    get_random_engine().seed(seed);
+}
+
 // 0-1
 inline float get_random_float()
 {
-    static std::random_device dev; // 随机设备dev，以dev生成的随机数为随机种子
-    static std::mt19937 rng(dev()); // 使用梅森旋转算法生成伪随机数，以dev为种子
-    static std::uniform_real_distribution<float> dist(0.f, 1.f); // 均匀实数分布，范围[0,1]的浮点数
+    static thread_local std::uniform_real_distribution<float> dist(0.f, 1.f); // 均匀实数分布，范围[0,1]的浮点数
 
-    return dist(rng); // 使用rng作为随机数源，从dist分布中抽取一个随机数
+    return dist(get_random_engine()); // 使用rng作为随机数源，从dist分布中抽取一个随机数
+}
+
+// FNV-1a哈希，用于校验断点文件与当前场景/设置是否一致
+inline uint64_t hash_bytes(const void *data, size_t size, uint64_t h = 14695981039346656037ULL)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// 将两个值混合为一个种子（splitmix64的混合函数）
+inline uint64_t hash_combine(uint64_t seed, uint64_t v)
+{
+    uint64_t z = seed + 0x9e3779b97f4a7c15ULL + (v << 6) + (v >> 2);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
 }
 
 inline void UpdateProgress(float progress)
@@ -9,7 +9,17 @@
 #include "Diffuse.hpp"
 #include "Mirror.hpp"
 #include "Transparent.hpp"
+#include "HomoMedium.hpp"
+#include "GridMedium.hpp"
+#include "BoundedMedium.hpp"
+#include "VoxelGrid.hpp"
+#include "BrickGrid.hpp"
+#include "TabulatedPhaseFunction.hpp"
 #include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <string>
 
 // TODO: 1.微表面模型（kulla-conty 参考202作业4），加入纹理（线性叠加，参考101作业3）（√，还有问题），以及复杂表面的细节效果 
 // 2. 伽马矫正(√) 
@@ -112,14 +122,181 @@ int main(int argc, char** argv)
     //scene.Add(&sphereLight);
     //scene.Add(&testObj);
 
-    scene.buildBVH();
-
     Renderer r;
+    std::vector<std::string> partials; // 需要合并的部分结果
+    std::string envMapPath; // 环境光贴图（等距柱状投影的HDR图）
+    float envMapScale = 1.f;
+    std::string mediumName; // 体积散射的介质：fog（均匀雾）、smoke（程序化烟雾）、.vol稠密体素文件或.bvol稀疏brick文件
+    float mediumDensity = 1.f;
+    std::string mediumBox, mediumMesh; // 介质的边界：包围盒"x0,y0,z0,x1,y1,z1"或闭合网格.obj，都没有时介质不加边界
+    bool outputGiven = false, checkpointGiven = false, aovPathGiven = false;
+    const Bounds3 smokeBounds(Vector3f(128.f, 0.f, 130.f), Vector3f(428.f, 450.f, 430.f)); // 程序化烟雾位于两个盒子之间
+
+    // 解析"a-b"形式的范围
+    auto parseRange = [](const char* arg, int &begin, int &end){
+        std::string range(arg);
+        auto dash = range.find('-');
+        if (dash == std::string::npos) return false;
+        begin = std::stoi(range.substr(0, dash));
+        end = std::stoi(range.substr(dash + 1));
+        return begin <= end;
+    };
+
+    // 命令行参数
+    for (int i = 1; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--resume")) r.resume = true;
+        else if (!std::strcmp(argv[i], "--spp") && hasValue) r.spp = std::stoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--pass-spp") && hasValue) r.passSpp = std::max(1, std::stoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--threads") && hasValue) r.thread_num = std::max(1, std::stoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--packet") && hasValue) r.packetSize = std::stoi(argv[++i]);
+        else if (!std::strcmp(argv[i], "--sort-rays")) scene.sortSecondaryRays = true;
+        else if (!std::strcmp(argv[i], "--light-bvh")) scene.useLightBVH = true;
+        else if (!std::strcmp(argv[i], "--envmap") && hasValue) envMapPath = argv[++i];
+        else if (!std::strcmp(argv[i], "--envmap-scale") && hasValue) envMapScale = std::stof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--medium") && hasValue) mediumName = argv[++i];
+        else if (!std::strcmp(argv[i], "--medium-density") && hasValue) mediumDensity = std::stof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--medium-box") && hasValue) mediumBox = argv[++i];
+        else if (!std::strcmp(argv[i], "--medium-mesh") && hasValue) mediumMesh = argv[++i];
+        else if (!std::strcmp(argv[i], "--equiangular")) scene.equiangularSampling = true;
+        else if (!std::strcmp(argv[i], "--phase") && hasValue) {
+            // 介质的相函数：HG的g、Cornette-Shanks（cs:g，查表）或测量数据文件（查表）
+            std::string phase = argv[++i];
+            if (phase.compare(0, 3, "cs:") == 0) scene.phase = TabulatedPhaseFunction::cornetteShanks(std::stof(phase.substr(3)));
+            else if (!phase.empty() && (std::isdigit((unsigned char)phase[0]) || phase[0] == '-' || phase[0] == '.'))
+                scene.phase = std::make_unique<HenyeyGreensteinMedium>(std::stof(phase));
+            else {
+                scene.phase = TabulatedPhaseFunction::load(phase);
+                if (!scene.phase) return 1;
+            }
+        }
+        else if (!std::strcmp(argv[i], "--convert-volume") && i + 2 < argc) {
+            // 把.vol稠密体素文件（或smoke）转换为.bvol稀疏brick文件后退出
+            std::string input = argv[++i], output = argv[++i];
+            auto grid = input == "smoke" ? VoxelGrid::smoke(smokeBounds, 128) :
+                                           VoxelGrid::loadVol(input);
+            return grid && BrickGrid::write(output, *grid) ? 0 : 1;
+        }
+        else if (!std::strcmp(argv[i], "--ris") && hasValue) scene.risCandidates = std::max(0, std::stoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--ris-spatial")) scene.risSpatialReuse = true;
+        else if (!std::strcmp(argv[i], "--guiding")) scene.usePathGuiding = true;
+        else if (!std::strcmp(argv[i], "--denoise")) r.denoise = true;
+        else if (!std::strcmp(argv[i], "--aov") && hasValue) {
+            if (!parseAOVs(argv[++i], r.aovs)) { std::cerr << "Unknown AOV list: " << argv[i] << "\n"; return 1; }
+        }
+        else if (!std::strcmp(argv[i], "--aov-output") && hasValue) { r.aovPath = argv[++i]; aovPathGiven = true; }
+        else if (!std::strcmp(argv[i], "--denoise-iterations") && hasValue) r.denoiseIterations = std::max(1, std::stoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--radiance-cache") && hasValue) scene.radianceCachePasses = std::max(0, std::stoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--radiance-cache-error") && hasValue) scene.radianceCacheError = std::stof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--radiance-cache-cell") && hasValue) scene.radianceCacheCellSize = std::stof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--seed") && hasValue) r.seed = (uint32_t)std::stoul(argv[++i]);
+        else if (!std::strcmp(argv[i], "--output") && hasValue) { r.outputPath = argv[++i]; outputGiven = true; }
+        else if (!std::strcmp(argv[i], "--checkpoint") && hasValue) { r.checkpointPath = argv[++i]; checkpointGiven = true; }
+        else if (!std::strcmp(argv[i], "--checkpoint-interval") && hasValue) r.checkpointInterval = std::stof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--rows") && hasValue && parseRange(argv[i + 1], r.rowBegin, r.rowEnd)) ++i;
+        else if (!std::strcmp(argv[i], "--samples") && hasValue && parseRange(argv[i + 1], r.sampleBegin, r.sampleEnd)) ++i;
+        else if (!std::strcmp(argv[i], "--partial") && hasValue) r.partialPath = argv[++i];
+        else if (!std::strcmp(argv[i], "--reference") && hasValue) r.referencePath = argv[++i];
+        else if (!std::strcmp(argv[i], "--target-error") && hasValue) r.targetError = std::stof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--photons") && hasValue) r.photonsPerIteration = std::max(0, std::stoi(argv[++i]));
+        else if (!std::strcmp(argv[i], "--photon-radius") && hasValue) r.photonRadius = std::stof(argv[++i]);
+        else if (!std::strcmp(argv[i], "--integrator") && hasValue) {
+            std::string name = argv[++i];
+            if (name == "path") r.integrator = Integrator::PATH;
+            else if (name == "whitted") r.integrator = Integrator::WHITTED;
+            else if (name == "wavefront") r.integrator = Integrator::WAVEFRONT;
+            else if (name == "bdpt") r.integrator = Integrator::BDPT;
+            else if (name == "sppm") r.integrator = Integrator::SPPM;
+            else { std::cerr << "Unknown integrator: " << name << "\n"; return 1; }
+        }
+        else if (!std::strcmp(argv[i], "--merge") && hasValue) {
+            while (i + 1 < argc) partials.push_back(argv[++i]);
+        }
+        else {
+            std::cerr << "Unknown option: " << argv[i] << "\n"
+                      << "Usage: " << argv[0] << " [--spp N] [--pass-spp N] [--threads N] [--packet 1|4|8|16] [--seed N] [--output file.ppm]\n"
+                      << "       [--checkpoint file] [--checkpoint-interval seconds] [--resume]\n"
+                      << "       [--rows a-b] [--samples a-b] [--partial file] [--integrator path|whitted|wavefront|bdpt|sppm] [--sort-rays] [--light-bvh]\n"
+                      << "       [--envmap file.hdr] [--envmap-scale s] [--ris M] [--ris-spatial] [--guiding] [--reference partial] [--target-error e]\n"
+                      << "       [--photons N] [--photon-radius r] [--radiance-cache passes] [--radiance-cache-error e] [--radiance-cache-cell size]\n"
+                      << "       [--denoise] [--denoise-iterations N] [--medium fog|smoke|file.vol|file.bvol] [--medium-density d]\n"
+                      << "       [--medium-box x0,y0,z0,x1,y1,z1] [--medium-mesh closed.obj] [--equiangular] [--phase g|cs:g|table.txt]\n"
+                      << "       [--convert-volume in.vol|smoke out.bvol]\n"
+                      << "       [--aov albedo,normal,depth,material,object,direct,indirect,samples|all] [--aov-output file.exr]\n"
+                      << "       " << argv[0] << " [--output file.ppm] [--partial file] --merge partial...\n";
+            return 1;
+        }
+    }
+
+    // 分片渲染时默认的断点和输出文件名带上行/采样范围（如pathTracing.rows0-512.samples0-64.ckpt），
+    // 同一目录下同时运行的各分片不会写同一个文件
+    bool sharded = r.rowBegin > 0 || r.rowEnd >= 0 || r.sampleBegin > 0 || r.sampleEnd >= 0;
+    if (sharded && partials.empty()) {
+        std::string suffix;
+        if (r.rowBegin > 0 || r.rowEnd >= 0) suffix += ".rows" + std::to_string(r.rowBegin) + "-" + std::to_string(r.rowEnd);
+        if (r.sampleBegin > 0 || r.sampleEnd >= 0) suffix += ".samples" + std::to_string(r.sampleBegin) + "-" + std::to_string(r.sampleEnd);
+        auto shardPath = [&](const std::string &path) {
+            size_t dot = path.find_last_of('.');
+            size_t slash = path.find_last_of("/\\");
+            if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + suffix;
+            return path.substr(0, dot) + suffix + path.substr(dot);
+        };
+        if (!outputGiven) r.outputPath = shardPath(r.outputPath);
+        if (!checkpointGiven && !r.checkpointPath.empty()) r.checkpointPath = shardPath(r.checkpointPath);
+        if (!aovPathGiven) r.aovPath = shardPath(r.aovPath);
+    }
+
+    if (!envMapPath.empty()) {
+        scene.environment = std::make_unique<EnvironmentLight>(envMapPath, envMapScale);
+        if (!scene.environment->valid()) return 1;
+    }
+
+    // 介质的系数乘以mediumDensity；体素文件的密度放在文件给出的包围盒中
+    std::unique_ptr<MeshTriangle> boundaryMesh; // 介质边界的网格，不加入场景
+    if (!mediumName.empty()) {
+        std::unique_ptr<Medium> medium;
+        auto endsWith = [&](const char *suffix) {
+            size_t n = std::strlen(suffix);
+            return mediumName.size() >= n && mediumName.compare(mediumName.size() - n, n, suffix) == 0;
+        };
+        if (mediumName == "fog") {
+            medium = std::make_unique<HomoMedium>(0.00025f * mediumDensity, 0.0003f * mediumDensity, scene.phase.get());
+        } else {
+            std::unique_ptr<DensityGrid> grid;
+            if (mediumName == "smoke") grid = VoxelGrid::smoke(smokeBounds, 128);
+            else if (endsWith(".bvol")) grid = BrickGrid::load(mediumName);
+            else grid = VoxelGrid::loadVol(mediumName);
+            if (!grid) return 1;
+            medium = std::make_unique<GridMedium>(std::move(grid), 0.004f * mediumDensity, 0.02f * mediumDensity, scene.phase.get());
+        }
+        if (!mediumBox.empty()) {
+            float b[6];
+            if (std::sscanf(mediumBox.c_str(), "%f,%f,%f,%f,%f,%f", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]) != 6) {
+                std::cerr << "Invalid medium box: " << mediumBox << "\n";
+                return 1;
+            }
+            medium = std::make_unique<BoundedMedium>(std::move(medium), Bounds3(Vector3f(b[0], b[1], b[2]), Vector3f(b[3], b[4], b[5])));
+        } else if (!mediumMesh.empty()) {
+            boundaryMesh = std::make_unique<MeshTriangle>(mediumMesh, white.get());
+            medium = std::make_unique<BoundedMedium>(std::move(medium), boundaryMesh.get());
+        }
+        scene.media.push_back(std::move(medium));
+    }
+
+    // 合并模式：只校验场景哈希并合并部分结果，只有降噪时需要构建BVH（特征缓冲要追踪主光线）
+    if (!partials.empty()) {
+        if (r.denoise) scene.buildBVH();
+        return r.Merge(scene, partials) ? 0 : 1;
+    }
+
+    scene.buildBVH();
 
     auto start = std::chrono::system_clock::now();
-    r.Render(scene);
+    bool finished = r.Render(scene);
     auto stop = std::chrono::system_clock::now();
 
+    if (!finished) return 1;
+
     std::cout << "Render complete: \n";
     std::cout << "Time taken: " << std::chrono::duration_cast<std::chrono::hours>(stop - start).count() << " hours\n";
     std::cout << "          : " << std::chrono::duration_cast<std::chrono::minutes>(stop - start).count() << " minutes\n";